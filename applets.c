@@ -0,0 +1,475 @@
+#include "applets.h"
+
+#include "shell.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <linux/limits.h>
+
+char const* unescape(char const* s, int* c);
+int test_args(int argc, char* argv[]);
+int test_unary(char const* op, char const* arg);
+int test_binary(char const* left, char const* op, char const* right);
+bool test_is_binary(char const* op);
+bool test_number(char const* s, long long* n);
+int test_not(int status);
+bool print_format(builtin_io* io, char const* fmt, int argc, char* argv[],
+	int* arg, int* status);
+char const* print_arg(int argc, char* argv[], int* arg);
+bool print_number(char const* s, long long* n);
+
+/*
+*	Public functions
+*/
+
+/*
+*	echo [-neE] [arg...]
+*/
+int applet_echo(builtin_io* io, int argc, char* argv[]) {
+	bool newline = true, escapes = false;
+	char const *s, *f;
+	char ch;
+	int i, c;
+
+	/* only options if every letter is one */
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+		if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1))
+			break;
+
+		for (f = argv[i] + 1; *f; ++f) {
+			if (*f == 'n')
+				newline = false;
+			else
+				escapes = *f == 'e';
+		}
+	}
+
+	for (; i < argc; ++i) {
+		if (!escapes) {
+			io_write(io, argv[i], strlen(argv[i]));
+		} else {
+			for (s = argv[i]; *s; ) {
+				if (*s != '\\' || !s[1]) {
+					io_write(io, s++, 1);
+					continue;
+				}
+
+				s = unescape(s + 1, &c);
+				/* \c, nothing more gets printed */
+				if (c < 0)
+					return 0;
+				ch = c;
+				io_write(io, &ch, 1);
+			}
+		}
+
+		if (i + 1 < argc)
+			io_write(io, " ", 1);
+	}
+
+	if (newline)
+		io_write(io, "\n", 1);
+
+	return 0;
+}
+
+int applet_true(builtin_io* io, int argc, char* argv[]) {
+	UNUSED(io);
+	UNUSED(argc);
+	UNUSED(argv);
+
+	return 0;
+}
+
+int applet_false(builtin_io* io, int argc, char* argv[]) {
+	UNUSED(io);
+	UNUSED(argc);
+	UNUSED(argv);
+
+	return 1;
+}
+
+/*
+*	test expr, [ expr ]: 0 if true, 1 if false and 2 for errors. Goes
+*	by the number of arguments like POSIX says, -a and -o aren't
+*	supported.
+*/
+int applet_test(builtin_io* io, int argc, char* argv[]) {
+	UNUSED(io);
+
+	if (strcmp(argv[0], "[") == 0) {
+		if (strcmp(argv[argc - 1], "]") != 0) {
+			fprintf(stderr, "psh: [: missing ]\n");
+			return 2;
+		}
+		--argc;
+	}
+
+	return test_args(argc - 1, argv + 1);
+}
+
+/*
+*	printf format [arg...], the format is used again while there are
+*	arguments left
+*/
+int applet_printf(builtin_io* io, int argc, char* argv[]) {
+	int arg = 2, start, status = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: printf format [arguments]\n");
+		return 2;
+	}
+
+	do {
+		start = arg;
+		if (!print_format(io, argv[1], argc, argv, &arg, &status))
+			break;
+	} while (arg < argc && arg > start);
+
+	return status;
+}
+
+/*
+*	pwd [-L|-P], the cwd cd keeps track of, or the real one with -P
+*/
+int applet_pwd(builtin_io* io, int argc, char* argv[]) {
+	char cwd[PATH_MAX];
+
+	if (argc > 1 && strcmp(argv[1], "-P") == 0) {
+		if (!getcwd(cwd, sizeof(cwd))) {
+			perror("psh: pwd");
+			return 1;
+		}
+		io_printf(io, "%s\n", cwd);
+		return 0;
+	}
+
+	io_printf(io, "%s\n", psh->cwd);
+	return 0;
+}
+
+/*
+*	basename name [suffix]
+*/
+int applet_basename(builtin_io* io, int argc, char* argv[]) {
+	char const *name, *end, *start;
+	size_t len, slen;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: basename name [suffix]\n");
+		return 1;
+	}
+
+	name = argv[1];
+	end = name + strlen(name);
+
+	/* trailing slashes don't count */
+	while (end > name && end[-1] == '/')
+		--end;
+
+	/* nothing but slashes */
+	if (end == name) {
+		io_printf(io, "%s\n", name[0] ? "/" : "");
+		return 0;
+	}
+
+	for (start = end; start > name && start[-1] != '/'; --start) {}
+	len = end - start;
+
+	/* suffix only goes if something's left */
+	if (argc > 2) {
+		slen = strlen(argv[2]);
+		if (slen < len && strncmp(end - slen, argv[2], slen) == 0)
+			len -= slen;
+	}
+
+	io_write(io, start, len);
+	io_write(io, "\n", 1);
+	return 0;
+}
+
+/*
+*	Private functions
+*/
+
+/*
+*	One backslash escape, s is just past the backslash. Returns where
+*	the escape ends, *c is the character or -1 for \c.
+*/
+char const* unescape(char const* s, int* c) {
+	int i;
+
+	switch (*s) {
+	case 'a': *c = '\a'; break;
+	case 'b': *c = '\b'; break;
+	case 'c': *c = -1; break;
+	case 'e': *c = '\033'; break;
+	case 'f': *c = '\f'; break;
+	case 'n': *c = '\n'; break;
+	case 'r': *c = '\r'; break;
+	case 't': *c = '\t'; break;
+	case 'v': *c = '\v'; break;
+	case '\\': *c = '\\'; break;
+	case '0': case '1': case '2': case '3':
+	case '4': case '5': case '6': case '7':
+		/* \0nnn like echo, \nnn like printf */
+		if (*s == '0')
+			++s;
+		for (*c = 0, i = 0; i < 3 && *s >= '0' && *s <= '7'; ++i, ++s)
+			*c = *c * 8 + (*s - '0');
+		*c &= 0xff;
+		return s;
+	default:
+		/* not an escape, the backslash stays */
+		*c = '\\';
+		return s;
+	}
+
+	return s + 1;
+}
+
+int test_args(int argc, char* argv[]) {
+	switch (argc) {
+	case 0:
+		return 1;
+	case 1:
+		return argv[0][0] ? 0 : 1;
+	case 2:
+		if (strcmp(argv[0], "!") == 0)
+			return test_not(test_args(1, argv + 1));
+		return test_unary(argv[0], argv[1]);
+	case 3:
+		if (test_is_binary(argv[1]))
+			return test_binary(argv[0], argv[1], argv[2]);
+		if (strcmp(argv[0], "!") == 0)
+			return test_not(test_args(2, argv + 1));
+		if (strcmp(argv[0], "(") == 0 && strcmp(argv[2], ")") == 0)
+			return test_args(1, argv + 1);
+		break;
+	case 4:
+		if (strcmp(argv[0], "!") == 0)
+			return test_not(test_args(3, argv + 1));
+		if (strcmp(argv[0], "(") == 0 && strcmp(argv[3], ")") == 0)
+			return test_args(2, argv + 1);
+		break;
+	}
+
+	fprintf(stderr, "psh: test: unsupported expression\n");
+	return 2;
+}
+
+int test_unary(char const* op, char const* arg) {
+	struct stat st;
+	bool ok;
+
+	if (op[0] != '-' || !op[1] || op[2]) {
+		fprintf(stderr, "psh: test: %s: unary operator expected\n", op);
+		return 2;
+	}
+
+	switch (op[1]) {
+	case 'n': return arg[0] ? 0 : 1;
+	case 'z': return arg[0] ? 1 : 0;
+	case 'r': return access(arg, R_OK) == 0 ? 0 : 1;
+	case 'w': return access(arg, W_OK) == 0 ? 0 : 1;
+	case 'x': return access(arg, X_OK) == 0 ? 0 : 1;
+	case 'h':
+	case 'L':
+		return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode) ? 0 : 1;
+	}
+
+	ok = stat(arg, &st) == 0;
+
+	switch (op[1]) {
+	case 'e': break;
+	case 'f': ok = ok && S_ISREG(st.st_mode); break;
+	case 'd': ok = ok && S_ISDIR(st.st_mode); break;
+	case 'b': ok = ok && S_ISBLK(st.st_mode); break;
+	case 'c': ok = ok && S_ISCHR(st.st_mode); break;
+	case 'p': ok = ok && S_ISFIFO(st.st_mode); break;
+	case 'S': ok = ok && S_ISSOCK(st.st_mode); break;
+	case 's': ok = ok && st.st_size > 0; break;
+	default:
+		fprintf(stderr, "psh: test: %s: unary operator expected\n", op);
+		return 2;
+	}
+
+	return ok ? 0 : 1;
+}
+
+int test_binary(char const* left, char const* op, char const* right) {
+	long long l, r;
+
+	if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+		return strcmp(left, right) == 0 ? 0 : 1;
+	if (strcmp(op, "!=") == 0)
+		return strcmp(left, right) != 0 ? 0 : 1;
+	if (strcmp(op, "<") == 0)
+		return strcmp(left, right) < 0 ? 0 : 1;
+	if (strcmp(op, ">") == 0)
+		return strcmp(left, right) > 0 ? 0 : 1;
+
+	if (!test_number(left, &l) || !test_number(right, &r))
+		return 2;
+
+	if (strcmp(op, "-eq") == 0) return l == r ? 0 : 1;
+	if (strcmp(op, "-ne") == 0) return l != r ? 0 : 1;
+	if (strcmp(op, "-lt") == 0) return l < r ? 0 : 1;
+	if (strcmp(op, "-le") == 0) return l <= r ? 0 : 1;
+	if (strcmp(op, "-gt") == 0) return l > r ? 0 : 1;
+	return l >= r ? 0 : 1;
+}
+
+bool test_is_binary(char const* op) {
+	static char const *ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne",
+		"-lt", "-le", "-gt", "-ge", NULL};
+	int i;
+
+	for (i = 0; ops[i]; ++i) {
+		if (strcmp(op, ops[i]) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool test_number(char const* s, long long* n) {
+	char *end;
+
+	errno = 0;
+	*n = strtoll(s, &end, 10);
+	if (errno || end == s || *end) {
+		fprintf(stderr, "psh: test: %s: integer expression expected\n", s);
+		return false;
+	}
+
+	return true;
+}
+
+int test_not(int status) {
+	return status == 2 ? 2 : !status;
+}
+
+/*
+*	Goes through the format once, taking arguments from *arg on.
+*	Returns false if it hit \c and nothing more should be printed.
+*/
+bool print_format(builtin_io* io, char const* fmt, int argc, char* argv[],
+	int* arg, int* status) {
+
+	char spec[32];
+	char const *s, *start, *str;
+	long long n;
+	size_t len;
+	char ch;
+	int c;
+
+	for (s = fmt; *s; ) {
+		if (*s == '\\' && s[1]) {
+			s = unescape(s + 1, &c);
+			if (c < 0)
+				return false;
+			ch = c;
+			io_write(io, &ch, 1);
+			continue;
+		}
+
+		if (*s != '%') {
+			io_write(io, s++, 1);
+			continue;
+		}
+
+		if (s[1] == '%') {
+			io_write(io, "%", 1);
+			s += 2;
+			continue;
+		}
+
+		/* flags, width and precision go to snprintf as they are */
+		start = s++;
+		s += strspn(s, "-+ #0");
+		s += strspn(s, "0123456789");
+		if (*s == '.') {
+			++s;
+			s += strspn(s, "0123456789");
+		}
+
+		len = s - start;
+		if (!*s || len + 4 > sizeof(spec)) {
+			fprintf(stderr, "psh: printf: %s: invalid format\n", start);
+			*status = 1;
+			return false;
+		}
+		memcpy(spec, start, len);
+
+		switch (*s) {
+		case 's':
+			strcpy(spec + len, "s");
+			io_printf(io, spec, print_arg(argc, argv, arg));
+			break;
+		case 'c':
+			strcpy(spec + len, "c");
+			str = print_arg(argc, argv, arg);
+			if (str[0])
+				io_printf(io, spec, str[0]);
+			break;
+		case 'd':
+		case 'i':
+			strcpy(spec + len, "lld");
+			if (!print_number(print_arg(argc, argv, arg), &n))
+				*status = 1;
+			io_printf(io, spec, n);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			sprintf(spec + len, "ll%c", *s);
+			if (!print_number(print_arg(argc, argv, arg), &n))
+				*status = 1;
+			io_printf(io, spec, (unsigned long long)n);
+			break;
+		default:
+			fprintf(stderr, "psh: printf: %%%c: invalid directive\n", *s);
+			*status = 1;
+			return false;
+		}
+		++s;
+	}
+
+	return true;
+}
+
+/* next argument, or nothing once they've run out */
+char const* print_arg(int argc, char* argv[], int* arg) {
+	if (*arg >= argc)
+		return "";
+
+	return argv[(*arg)++];
+}
+
+bool print_number(char const* s, long long* n) {
+	char *end;
+
+	/* 'a is the character's value */
+	if (s[0] == '\'' || s[0] == '"') {
+		*n = (unsigned char)s[1];
+		return true;
+	}
+
+	errno = 0;
+	*n = strtoll(s, &end, 0);
+	if (!*s)
+		return true;
+	if (errno || *end) {
+		fprintf(stderr, "psh: printf: %s: invalid number\n", s);
+		return false;
+	}
+
+	return true;
+}
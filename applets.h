@@ -0,0 +1,17 @@
+#ifndef _APPLETS_GUARD
+#define _APPLETS_GUARD
+
+#include "builtin.h"
+
+/* small commands run in the shell instead of forking a program,
+ * registered with the other builtins */
+
+int applet_echo(builtin_io* io, int argc, char* argv[]);
+int applet_true(builtin_io* io, int argc, char* argv[]);
+int applet_false(builtin_io* io, int argc, char* argv[]);
+int applet_test(builtin_io* io, int argc, char* argv[]);
+int applet_printf(builtin_io* io, int argc, char* argv[]);
+int applet_pwd(builtin_io* io, int argc, char* argv[]);
+int applet_basename(builtin_io* io, int argc, char* argv[]);
+
+#endif
@@ -0,0 +1,86 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK 256
+
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+arena_block* new_block(size_t size);
+
+/*
+*	Public functions
+*/
+
+/*
+*	size is a hint for the first block, later ones grow geometrically
+*/
+void arena_init(arena* a, size_t size) {
+	a->block = new_block(size < ARENA_MIN_BLOCK ? ARENA_MIN_BLOCK : size);
+}
+
+void arena_free(arena* a) {
+	arena_block *b = a->block;
+	arena_block *next;
+
+	while (b) {
+		next = b->next;
+		free(b);
+		b = next;
+	}
+
+	a->block = NULL;
+}
+
+void* arena_alloc(arena* a, size_t size) {
+	arena_block *b = a->block;
+	size_t want;
+	void *ret;
+
+	size = ALIGN_UP(size);
+
+	if (!b || b->size - b->used < size) {
+		/* at least double, so the block count stays logarithmic */
+		want = b ? b->size * 2 : ARENA_MIN_BLOCK;
+		if (want < size)
+			want = size;
+
+		b = new_block(want);
+		b->next = a->block;
+		a->block = b;
+	}
+
+	ret = b->data + b->used;
+	b->used += size;
+
+	return ret;
+}
+
+char* arena_strndup(arena* a, char const* str, size_t len) {
+	char *ret = arena_alloc(a, len + 1);
+
+	memcpy(ret, str, len);
+	ret[len] = '\0';
+
+	return ret;
+}
+
+/*
+*	Private functions
+*/
+
+arena_block* new_block(size_t size) {
+	arena_block *b;
+
+	size = ALIGN_UP(size);
+	b = malloc(ALIGN_UP(sizeof(arena_block)) + size);
+
+	b->next = NULL;
+	b->size = size;
+	b->used = 0;
+	b->data = (char*)b + ALIGN_UP(sizeof(arena_block));
+
+	return b;
+}
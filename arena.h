@@ -0,0 +1,27 @@
+#ifndef _ARENA_GUARD
+#define _ARENA_GUARD
+
+#include <stddef.h>
+
+/* bump allocator, everything gets freed at once */
+
+typedef struct arena_block {
+	struct arena_block* next;
+
+	size_t size;
+	size_t used;
+	/* max_align_t aligned, see arena_alloc */
+	char* data;
+} arena_block;
+
+typedef struct arena {
+	arena_block* block;
+} arena;
+
+void arena_init(arena* a, size_t size);
+void arena_free(arena* a);
+
+void* arena_alloc(arena* a, size_t size);
+char* arena_strndup(arena* a, char const* str, size_t len);
+
+#endif
@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+#	Commands per second for applets run in the shell, applets forked
+#	in a pipeline and the programs they stand in for, each as a script
+#	repeating one line.
+#
+#	applets.sh [psh] [lines], default bin/psh and 100000. Programs get
+#	a fiftieth of the lines, they're that much slower.
+#
+psh=${1:-bin/psh}
+lines=${2:-100000}
+
+script=$(mktemp)
+trap 'rm -f "$script"' EXIT
+
+# lines of $2 run $1 times, commands per second
+run() {
+	yes "$2" | head -n "$1" > "$script"
+
+	start=$(date +%s%N)
+	"$psh" "$script" > /dev/null || exit 1
+	end=$(date +%s%N)
+	echo $(($1 * 1000000000 / (end - start)))
+}
+
+few=$((lines / 50))
+echo "true: $(run "$lines" true)/s"
+echo "/bin/true: $(run "$few" /bin/true)/s"
+echo "echo x: $(run "$lines" 'echo x')/s"
+echo "/bin/echo x: $(run "$few" '/bin/echo x')/s"
+echo "true | true: $(run "$few" 'true | true')/s"
+echo "/bin/true | /bin/true: $(run "$few" '/bin/true | /bin/true')/s"
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+#	Commands per second in batch mode, for each way of giving psh a
+#	script.
+#
+#	batch.sh [psh] [lines], default bin/psh and 100000. Programs get a
+#	fiftieth of the lines, they're that much slower.
+#
+psh=${1:-bin/psh}
+lines=${2:-100000}
+
+script=$(mktemp)
+trap 'rm -f "$script"' EXIT
+
+# commands per second, $1 lines, then how to run it
+rate() {
+	count=$1
+	shift
+
+	start=$(date +%s%N)
+	"$@" > /dev/null || exit 1
+	end=$(date +%s%N)
+	echo $((count * 1000000000 / (end - start)))
+}
+
+yes true | head -n "$lines" > "$script"
+echo "true, psh file: $(rate "$lines" "$psh" "$script")/s"
+echo "true, piped in: $(rate "$lines" sh -c '"$0" < "$1"' "$psh" "$script")/s"
+# one argument can only be 128KB
+short=$((lines < 20000 ? lines : 20000))
+echo "true, psh -c: $(rate "$short" "$psh" -c "$(head -n "$short" "$script")")/s"
+
+# every line different, so none of them come from the parse cache
+seq "$lines" | sed 's/^/true /' > "$script"
+echo "true n, psh file: $(rate "$lines" "$psh" "$script")/s"
+
+few=$((lines / 50))
+yes /bin/true | head -n "$few" > "$script"
+echo "/bin/true, psh file: $(rate "$few" "$psh" "$script")/s"
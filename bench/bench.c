@@ -0,0 +1,83 @@
+#include "bench.h"
+
+#include "shell.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* the benchmarks link the shell without main.c */
+shell_state *psh = NULL;
+
+static uint32_t state = 1;
+
+int compare_times(void const* a, void const* b);
+
+/*
+*	Public functions
+*/
+
+double bench_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void bench_seed(uint32_t seed) {
+	state = seed ? seed : 1;
+}
+
+/* xorshift32 */
+uint32_t bench_rand(void) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return state;
+}
+
+void bench_times_init(bench_times* times) {
+	times->t = NULL;
+	times->count = times->cap = 0;
+}
+
+void bench_times_free(bench_times* times) {
+	free(times->t);
+	bench_times_init(times);
+}
+
+void bench_times_add(bench_times* times, double t) {
+	if (times->count == times->cap) {
+		times->cap = times->cap ? times->cap * 2 : 1024;
+		times->t = realloc(times->t, sizeof(double) * times->cap);
+	}
+
+	times->t[times->count++] = t;
+}
+
+/* count, median, 99th percentile and worst, in microseconds */
+void bench_times_print(char const* what, bench_times* times) {
+	size_t n = times->count;
+
+	if (!n) {
+		printf("%s: none\n", what);
+		return;
+	}
+
+	qsort(times->t, n, sizeof(double), &compare_times);
+	printf("%s: %zu, median %.1fus, p99 %.1fus, max %.1fus\n", what, n,
+		times->t[n / 2] * 1e6, times->t[n * 99 / 100] * 1e6,
+		times->t[n - 1] * 1e6);
+}
+
+/*
+*	Private functions
+*/
+
+int compare_times(void const* a, void const* b) {
+	double x = *(double const*)a, y = *(double const*)b;
+
+	return (x > y) - (x < y);
+}
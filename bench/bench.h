@@ -0,0 +1,25 @@
+#ifndef _BENCH_GUARD
+#define _BENCH_GUARD
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* timings in seconds, kept to report percentiles */
+typedef struct bench_times {
+	double* t;
+	size_t count;
+	size_t cap;
+} bench_times;
+
+double bench_now(void);
+
+/* the same numbers every run, so results compare */
+void bench_seed(uint32_t seed);
+uint32_t bench_rand(void);
+
+void bench_times_init(bench_times* times);
+void bench_times_free(bench_times* times);
+void bench_times_add(bench_times* times, double t);
+void bench_times_print(char const* what, bench_times* times);
+
+#endif
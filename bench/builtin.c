@@ -0,0 +1,94 @@
+/*
+*	Time per builtin_get as builtins get registered, next to the linear
+*	scan it replaced, which went through the whole table every time.
+*
+*	builtin [lookups], default 10000000
+*/
+#include "builtin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+/* what the shell looks up, two builtins and two programs */
+static char const* queries[] = {"ls", "cd", "grep", "hash"};
+
+/* the same builtins in the order the old static table had them */
+static char const* names[] = {"cd", "history", "!", "hash", "load", "exit",
+	"echo", "true", "false", "test", "[", "printf", "pwd", "basename"};
+
+#define NAMES (sizeof(names) / sizeof(names[0]))
+#define MAX_EXTRA 1024
+
+static builtin linear[NAMES + MAX_EXTRA + 1];
+
+builtin const* linear_get(char const* name);
+int dummy(builtin_io* io, int argc, char* argv[]);
+
+int main(int argc, char* argv[]) {
+	size_t sizes[] = {0, 16, 64, 256, MAX_EXTRA};
+	size_t lookups = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+	size_t count = NAMES, i, s;
+	char name[32];
+	double lin, hash;
+	volatile size_t hits = 0;
+
+	builtin_init();
+	for (i = 0; i < NAMES; ++i)
+		linear[i] = *builtin_get(names[i]);
+
+	printf("%-16s%-16s%s\n", "extra builtins", "linear ns", "hash ns");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		for (; count < NAMES + sizes[s]; ++count) {
+			snprintf(name, sizeof(name), "d%zu", count - NAMES);
+			builtin_register(name, dummy);
+			linear[count] = *builtin_get(name);
+		}
+
+		lin = bench_now();
+		for (i = 0; i < lookups; ++i)
+			hits += linear_get(queries[i & 3]) != NULL;
+		lin = bench_now() - lin;
+
+		hash = bench_now();
+		for (i = 0; i < lookups; ++i)
+			hits += builtin_get(queries[i & 3]) != NULL;
+		hash = bench_now() - hash;
+
+		printf("%-16zu%-16.1f%.1f\n", sizes[s], lin / lookups * 1e9,
+			hash / lookups * 1e9);
+	}
+
+	builtin_destroy();
+
+	return 0;
+}
+
+/*
+*	The lookup before the hash table, kept as it was
+*/
+builtin const* linear_get(char const* name) {
+	int i = 0;
+	builtin const *ret = NULL;
+	builtin const *bin;
+
+	bin = &linear[i];
+	while(bin->name && bin->func) {
+		if (strcmp(bin->name, name) == 0) {
+			ret = bin;
+		}
+		bin = &linear[++i];
+	}
+
+	return ret;
+}
+
+int dummy(builtin_io* io, int argc, char* argv[]) {
+	(void)io;
+	(void)argc;
+	(void)argv;
+
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+*	History append, access by number and up arrow presses, for the
+*	history as it is and for the linked list it replaced.
+*
+*	history [entries...], default 100000 and 1000000. The list is only
+*	run up to LIST_MAX entries, each one takes a 4KB node.
+*/
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define LIST_MAX 100000
+#define LIST_LINE 4096
+
+/* the old history, a node per line and the newest at the end */
+typedef struct list_line {
+	struct list_line* prev;
+	struct list_line* next;
+
+	char buffer[LIST_LINE];
+} list_line;
+
+typedef struct list {
+	list_line* first;
+	list_line* current;
+} list;
+
+void bench_list(size_t n);
+void bench_index(size_t n);
+list_line* list_add(list* l);
+char const* list_get(list* l, size_t n);
+char const* list_up(list* l, char* buf, size_t depth);
+void list_destroy(list* l);
+
+/* keeps the compiler from dropping what gets looked up */
+static volatile size_t sink;
+
+int main(int argc, char* argv[]) {
+	size_t sizes[] = {100000, 1000000};
+	size_t i, n;
+
+	for (i = 0; i < (argc > 1 ? (size_t)argc - 1 : 2); ++i) {
+		n = argc > 1 ? strtoul(argv[i + 1], NULL, 10) : sizes[i];
+
+		if (n <= LIST_MAX)
+			bench_list(n);
+		bench_index(n);
+	}
+
+	return 0;
+}
+
+void bench_list(size_t n) {
+	static char buf[LIST_LINE];
+	list l = {NULL, NULL};
+	size_t i, depth;
+	double t;
+
+	printf("list, %zu entries:\n", n);
+
+	t = bench_now();
+	for (i = 0; i < n; ++i)
+		snprintf(list_add(&l)->buffer, LIST_LINE, "echo entry %zu", i);
+	printf("  append: %.0f ns\n", (bench_now() - t) / n * 1e9);
+
+	/* what `! n` did, walking from the oldest */
+	t = bench_now();
+	for (i = 0; i < 100; ++i)
+		sink += list_get(&l, n / 2 + i)[0];
+	printf("  get entry n/2: %.1f us\n", (bench_now() - t) / 100 * 1e6);
+
+	for (depth = 10; depth < n; depth *= 10) {
+		t = bench_now();
+		for (i = 0; i < 100; ++i)
+			sink += list_up(&l, buf, depth)[0];
+		printf("  one up press, depth %zu: %.0f ns\n", depth,
+			(bench_now() - t) / 100 * 1e9);
+	}
+
+	t = bench_now();
+	for (i = 0; i < 10000 && i + 1 < n; ++i)
+		sink += list_up(&l, buf, i)[0];
+	printf("  holding up, %zu keys: %.2f ms\n", i, (bench_now() - t) * 1e3);
+
+	list_destroy(&l);
+}
+
+void bench_index(size_t n) {
+	history *hist = history_init(NULL);
+	history_cursor cur;
+	char const *s;
+	char line[64];
+	size_t i, depth;
+	double t;
+	int len;
+
+	printf("index, %zu entries:\n", n);
+
+	t = bench_now();
+	for (i = 0; i < n; ++i) {
+		len = snprintf(line, sizeof(line), "echo entry %zu", i);
+		history_add(hist, line, len);
+	}
+	printf("  append: %.0f ns\n", (bench_now() - t) / n * 1e9);
+
+	t = bench_now();
+	for (i = 0; i < 100; ++i)
+		sink += history_get(hist, n / 2 + i)[0];
+	printf("  get entry n/2: %.3f us\n", (bench_now() - t) / 100 * 1e6);
+
+	for (depth = 10; depth < n; depth *= 10) {
+		t = bench_now();
+		for (i = 0; i < 100; ++i) {
+			cur.pos = n - depth;
+			sink += history_prev(hist, &cur)[0];
+		}
+		printf("  one up press, depth %zu: %.0f ns\n", depth,
+			(bench_now() - t) / 100 * 1e9);
+	}
+
+	history_cursor_reset(hist, &cur);
+	t = bench_now();
+	for (i = 0; i < 10000 && (s = history_prev(hist, &cur)); ++i)
+		sink += s[0];
+	printf("  holding up, %zu keys: %.2f ms\n", i, (bench_now() - t) * 1e3);
+
+	history_cursor_reset(hist, &cur);
+	t = bench_now();
+	for (i = 0; (s = history_prev(hist, &cur)); ++i)
+		sink += s[0];
+	printf("  holding up, %zu keys: %.2f ms\n", i, (bench_now() - t) * 1e3);
+
+	history_destroy(hist);
+}
+
+/*
+*	The old list functions, kept as they were apart from the terminal
+*/
+list_line* list_add(list* l) {
+	list_line *last;
+	list_line *hist = malloc(sizeof(list_line));
+	memset(hist->buffer, 0, sizeof(hist->buffer));
+	hist->prev = NULL;
+	hist->next = NULL;
+
+	if (!l->first) {
+		l->first = hist;
+		l->current = hist;
+	} else {
+		/* existing history, append to list */
+		last = l->current;
+		while (last && last->next) {
+			last = last->next;
+		}
+
+		last->next = hist;
+		hist->prev = last;
+		l->current = hist;
+	}
+
+	return hist;
+}
+
+char const* list_get(list* l, size_t n) {
+	list_line *hist = l->first;
+
+	while (n-- && hist->next)
+		hist = hist->next;
+
+	return hist->buffer;
+}
+
+/*
+*	An up press with depth entries above the line, the redraw that
+*	followed is left out
+*/
+char const* list_up(list* l, char* buf, size_t depth) {
+	list_line *hist = l->current;
+	size_t i;
+
+	for (i = 0; i < depth + 1; ++i) {
+		if (!hist)
+			return "";
+		hist = hist->prev;
+	}
+	if (!hist)
+		return "";
+
+	strcpy(buf, hist->buffer);
+
+	return buf;
+}
+
+void list_destroy(list* l) {
+	list_line *hist = l->first;
+	list_line *next;
+
+	while (hist) {
+		next = hist->next;
+		free(hist);
+		hist = next;
+	}
+}
@@ -0,0 +1,154 @@
+/*
+*	Time per keystroke for autosuggestions and Ctrl-R search over a
+*	large history, while the indexes are still being built and after.
+*
+*	keys [entries...], default 100000 and 1000000
+*/
+#include "history.h"
+#include "prefix.h"
+#include "search.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+/* what gets typed, a mix of lines that are in history and ones that
+ * aren't */
+static char const* typed[] = {
+	"git status",
+	"make -j8 install",
+	"zq frobnicate --now",
+	"ssh build-07",
+	"grep -rn TODO src/",
+	"kubectl describe pod web-4",
+	"xyzzy plugh",
+	"cd ~/projects/psh",
+	"docker run --rm -it alpine sh",
+	"vim notes-2024.txt"
+};
+
+#define TYPED (sizeof(typed) / sizeof(typed[0]))
+
+void fill(history* hist, size_t n);
+void suggest_keys(history* hist, size_t n);
+void search_keys(history* hist, size_t n);
+bool suggest_done(history* hist);
+
+int main(int argc, char* argv[]) {
+	size_t sizes[] = {100000, 1000000};
+	size_t i, n;
+	history *hist;
+
+	for (i = 0; i < (argc > 1 ? (size_t)argc - 1 : 2); ++i) {
+		n = argc > 1 ? strtoul(argv[i + 1], NULL, 10) : sizes[i];
+
+		hist = history_init(NULL);
+		fill(hist, n);
+		suggest_keys(hist, n);
+		history_destroy(hist);
+
+		hist = history_init(NULL);
+		fill(hist, n);
+		search_keys(hist, n);
+		history_destroy(hist);
+	}
+
+	return 0;
+}
+
+void fill(history* hist, size_t n) {
+	static char const* cmds[] = {"git", "make", "ls", "cd", "grep", "vim",
+		"ssh", "docker", "kubectl", "cat", "less", "python3"};
+	static char const* args[] = {"status", "-la", "--rm", "src/", "log",
+		"-j8", "build", "install", "web", "notes", "pod", "-rn"};
+	char line[128];
+	size_t i;
+	int len;
+
+	bench_seed(1);
+	for (i = 0; i < n; ++i) {
+		len = snprintf(line, sizeof(line), "%s %s %s-%u",
+			cmds[bench_rand() % 12], args[bench_rand() % 12],
+			args[bench_rand() % 12], bench_rand() % 100000);
+		history_add(hist, line, len);
+	}
+}
+
+bool suggest_done(history* hist) {
+	prefix_index *idx = hist->prefixes;
+
+	return idx && idx->lo == 0 && !idx->merge.ids;
+}
+
+/* types the lines over and over, first until the index is built */
+void suggest_keys(history* hist, size_t n) {
+	bench_times building, built;
+	size_t keys, line, len;
+	double t;
+
+	bench_times_init(&building);
+	bench_times_init(&built);
+
+	for (keys = 0; !suggest_done(hist) || built.count < 10000; ++keys) {
+		line = (keys / 16) % TYPED;
+		len = keys % 16 + 1;
+		if (len > strlen(typed[line]))
+			len = strlen(typed[line]);
+
+		t = bench_now();
+		history_suggest(hist, typed[line], len);
+		t = bench_now() - t;
+
+		bench_times_add(suggest_done(hist) ? &built : &building, t);
+	}
+
+	printf("suggest, %zu entries: %zu runs\n", n,
+		hist->prefixes->runc);
+	bench_times_print("  while building", &building);
+	bench_times_print("  built", &built);
+	bench_times_free(&building);
+	bench_times_free(&built);
+}
+
+/* each key is followed by one idle step, like the shell does */
+void search_keys(history* hist, size_t n) {
+	bench_times keys, steps, built;
+	search_index *idx = search_init(hist);
+	size_t k, line, len;
+	double t;
+	bool more = true;
+
+	bench_times_init(&keys);
+	bench_times_init(&steps);
+	bench_times_init(&built);
+
+	for (k = 0; more || built.count < 10000; ++k) {
+		line = (k / 16) % TYPED;
+		len = k % 16 + 1;
+		if (len > strlen(typed[line]))
+			len = strlen(typed[line]);
+
+		t = bench_now();
+		search_find(idx, typed[line], len, HISTORY_EDIT);
+		t = bench_now() - t;
+		bench_times_add(more ? &keys : &built, t);
+
+		if (more) {
+			t = bench_now();
+			more = search_step(idx);
+			bench_times_add(&steps, bench_now() - t);
+		}
+	}
+
+	printf("search, %zu entries:\n", n);
+	bench_times_print("  keys while indexing", &keys);
+	bench_times_print("  idle steps", &steps);
+	bench_times_print("  keys once indexed", &built);
+	bench_times_free(&keys);
+	bench_times_free(&steps);
+	bench_times_free(&built);
+	search_destroy(idx);
+}
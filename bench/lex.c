@@ -0,0 +1,269 @@
+/*
+*	Parsing throughput, the lexer against the strtok parser it
+*	replaced, on a script of everyday short words and one of long
+*	paths.
+*
+*	lex [lines] [passes], default 200000 and 20
+*/
+#include "input.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+/* the old parser's limits and line */
+#define OLD_BUFFER 4096
+#define OLD_COMMANDS 16
+#define OLD_ARGC 16
+
+typedef struct old_line {
+	char buffer[OLD_BUFFER];
+	char *argv[OLD_COMMANDS][OLD_ARGC];
+
+	int cmdc;
+	int argc[OLD_COMMANDS];
+} old_line;
+
+/* lines one after another in text, NUL terminated */
+typedef struct script {
+	char* text;
+	size_t size;
+	size_t cap;
+
+	size_t* offs;
+	size_t count;
+	size_t offcap;
+} script;
+
+void gen_short(script* s, size_t count);
+void gen_long(script* s, size_t count);
+void script_add(script* s, char const* line, size_t len);
+void script_free(script* s);
+void bench_script(char const* what, script* s, int passes);
+old_line* old_parse(char const* text);
+void old_redirs(old_line* line);
+
+/* keeps the compiler from dropping the parses */
+static volatile size_t sink;
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+	int passes = argc > 2 ? atoi(argv[2]) : 20;
+	script s;
+
+	gen_short(&s, count);
+	bench_script("short words", &s, passes);
+	script_free(&s);
+
+	gen_long(&s, count);
+	bench_script("long paths", &s, passes);
+	script_free(&s);
+
+	return 0;
+}
+
+/*
+*	1-4 stage pipelines of everyday commands, some redirected or in
+*	the background
+*/
+void gen_short(script* s, size_t count) {
+	static char const* cmds[] = {
+		"ls -la", "cat notes/2024-report.txt", "grep -v -e warning build.log",
+		"sort -u -k2,2", "head -n 20", "wc -l", "awk -F: /usr/share/dict/words",
+		"git log --oneline --decorate origin/main", "tr a-z A-Z", "uniq -c",
+		"gcc -O2 -Wall -Wextra -o psh main.c shell.c", "make -j8", "cut -d, -f1"
+	};
+	char line[512];
+	size_t i, len;
+	int stages, j;
+
+	bench_seed(8);
+	memset(s, 0, sizeof(*s));
+	for (i = 0; i < count; ++i) {
+		stages = 1 + bench_rand() % 4;
+		for (len = 0, j = 0; j < stages; ++j) {
+			len += snprintf(line + len, sizeof(line) - len, "%s%s",
+				j ? " | " : "", cmds[bench_rand() % 13]);
+		}
+		if (bench_rand() % 10 < 3)
+			len += snprintf(line + len, sizeof(line) - len, " > out%zu.txt", i);
+		if (bench_rand() % 10 == 0)
+			len += snprintf(line + len, sizeof(line) - len, " &");
+
+		script_add(s, line, len);
+	}
+}
+
+/* copying a 4-10 segment path, logging to a file */
+void gen_long(script* s, size_t count) {
+	static char const* parts[] = {
+		"usr", "share", "local", "include", "lib", "node_modules",
+		"x86_64-linux-gnu", "projects", "build-output", "documentation"
+	};
+	char path[512], line[1200];
+	size_t i, len;
+	int segs, j;
+
+	bench_seed(8);
+	memset(s, 0, sizeof(*s));
+	for (i = 0; i < count; ++i) {
+		segs = 4 + bench_rand() % 7;
+		for (len = 0, j = 0; j < segs; ++j) {
+			len += snprintf(path + len, sizeof(path) - len, "/%s",
+				parts[bench_rand() % 10]);
+		}
+		len = snprintf(line, sizeof(line),
+			"cp %s %s/backup-%zu.tar.gz > /var/log/copy-%zu.log",
+			path, path, i, i);
+
+		script_add(s, line, len);
+	}
+}
+
+void script_add(script* s, char const* line, size_t len) {
+	if (s->size + len + 1 > s->cap) {
+		s->cap = s->cap ? s->cap * 2 : 1 << 20;
+		s->text = realloc(s->text, s->cap);
+	}
+	if (s->count == s->offcap) {
+		s->offcap = s->offcap ? s->offcap * 2 : 1024;
+		s->offs = realloc(s->offs, sizeof(size_t) * s->offcap);
+	}
+
+	s->offs[s->count++] = s->size;
+	memcpy(s->text + s->size, line, len);
+	s->text[s->size + len] = '\0';
+	s->size += len + 1;
+}
+
+void script_free(script* s) {
+	free(s->text);
+	free(s->offs);
+}
+
+void bench_script(char const* what, script* s, int passes) {
+	double best_old = 1e9, best_new = 1e9, t;
+	parsed_line *line;
+	old_line *old;
+	size_t i;
+	int p;
+
+	for (p = 0; p < passes; ++p) {
+		t = bench_now();
+		for (i = 0; i < s->count; ++i) {
+			old = old_parse(s->text + s->offs[i]);
+			old_redirs(old);
+			sink += old->cmdc;
+			free(old);
+		}
+		t = bench_now() - t;
+		if (t < best_old)
+			best_old = t;
+
+		t = bench_now();
+		for (i = 0; i < s->count; ++i) {
+			line = parse_input(s->text + s->offs[i]);
+			sink += line->pipec;
+			line_release(line);
+		}
+		t = bench_now() - t;
+		if (t < best_new)
+			best_new = t;
+	}
+
+	printf("%s, %zu lines, %.1fMB:\n", what, s->count, s->size / 1e6);
+	printf("  strtok parser: %.0f MB/s, %.0f ns/line\n",
+		s->size / best_old / 1e6, best_old / s->count * 1e9);
+	printf("  lexer: %.0f MB/s, %.0f ns/line\n",
+		s->size / best_new / 1e6, best_new / s->count * 1e9);
+}
+
+/*
+*	The parser before the lexer, kept as it was apart from its input
+*/
+old_line* old_parse(char const* text) {
+	/* strtok_r state */
+	char *tok_pipe, *tok_cmd;
+	char *pipe_buf, *cmd_buf;
+
+	old_line *parse = malloc(sizeof(old_line));
+	memset(parse->buffer, 0, sizeof(parse->buffer));
+	memset(parse->argc, 0, sizeof(parse->argc));
+	memset(parse->argv, 0, sizeof(parse->argv));
+	memcpy(parse->buffer, text, strlen(text) + 1);
+
+	parse->cmdc = 0;
+
+	/* split by pipes */
+	pipe_buf = strtok_r(parse->buffer, "|", &tok_pipe);
+	while (pipe_buf != NULL) {
+		cmd_buf = strtok_r(pipe_buf, " \t\n", &tok_cmd);
+
+		/* then by spaces to get argv */
+		while (cmd_buf != NULL) {
+			if (parse->argc[parse->cmdc] < OLD_ARGC) {
+				parse->argv[parse->cmdc][parse->argc[parse->cmdc]++] = cmd_buf;
+			}
+			else
+			{
+				fprintf(stderr, "Too many args\n");
+				break;
+			}
+
+			cmd_buf = strtok_r(NULL, " \t\n", &tok_cmd);
+		}
+
+		++parse->cmdc;
+		if (parse->cmdc >= OLD_COMMANDS) {
+			fprintf(stderr, "Too many commands in pipeline\n");
+			break;
+		}
+		parse->argc[parse->cmdc] = 0;
+		pipe_buf = strtok_r(NULL, "|", &tok_pipe);
+	}
+
+	return parse;
+}
+
+/*
+*	The second pass over argv for < > and & that running a line used
+*	to make, which the lexer does as it goes
+*/
+void old_redirs(old_line* line) {
+	char *redir[OLD_COMMANDS][2];
+	char **argv;
+	int i, k, argc;
+
+	for (i = 0; i < line->cmdc; ++i) {
+		argv = line->argv[i];
+		argc = line->argc[i];
+		redir[i][0] = redir[i][1] = NULL;
+
+		for (k = 1; k < argc - 1; ++k) {
+			if (argv[k][0] == '<') {
+				redir[i][0] = argv[k+1];
+				argv[k] = NULL;
+				if (k < line->argc[i])
+					line->argc[i] = k;
+				++k;
+			} else if (argv[k][0] == '>') {
+				redir[i][1] = argv[k+1];
+				argv[k] = NULL;
+				if (k < line->argc[i])
+					line->argc[i] = k;
+				++k;
+			}
+		}
+		sink += (size_t)redir[i][1];
+	}
+
+	/* last argument of the last command */
+	argv = line->argv[line->cmdc - 1];
+	argc = line->argc[line->cmdc - 1];
+	if (argc && argv[argc - 1][0] == '&') {
+		argv[argc - 1] = NULL;
+		--line->argc[line->cmdc - 1];
+	}
+}
@@ -0,0 +1,96 @@
+/*
+*	Parsing a script's lines through the parse cache against parsing
+*	every one, for lines that repeat and lines that never do.
+*
+*	parsecache [iterations], default 1000000
+*/
+#include "parsecache.h"
+#include "strmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+/* how a line gets parsed */
+typedef enum mode {
+	PARSE, /* parse_input every time */
+	CACHED, /* parse_cached, as run_line does */
+	CACHE_ALL /* parse_cached, but caching lines the first time */
+} mode;
+
+double run(char const** lines, size_t count, mode how);
+
+/* keeps the compiler from dropping the parses */
+static volatile size_t sink;
+
+int main(int argc, char* argv[]) {
+	static char const* repeated[] = {
+		"true; test 1 -lt 2 && basename /a/b/c; echo \"a b\" c",
+		"true"
+	};
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	char const **lines = malloc(sizeof(char*) * count);
+	char *text = malloc(count * 24), *c;
+	size_t i, r;
+
+	for (r = 0; r < sizeof(repeated) / sizeof(repeated[0]); ++r) {
+		for (i = 0; i < count; ++i)
+			lines[i] = repeated[r];
+
+		printf("\"%s\" %zu times:\n", repeated[r], count);
+		printf("  parse: %.0f ms\n", run(lines, count, PARSE) * 1e3);
+		printf("  cached: %.0f ms\n", run(lines, count, CACHED) * 1e3);
+	}
+
+	/* a loop that never repeats a line */
+	for (c = text, i = 0; i < count; ++i) {
+		lines[i] = c;
+		c += sprintf(c, "echo line %zu", i) + 1;
+	}
+
+	printf("%zu different lines:\n", count);
+	printf("  parse: %.0f ms\n", run(lines, count, PARSE) * 1e3);
+	printf("  cached: %.0f ms\n", run(lines, count, CACHED) * 1e3);
+	printf("  cached without the seen filter: %.0f ms\n",
+		run(lines, count, CACHE_ALL) * 1e3);
+
+	free(text);
+	free(lines);
+
+	return 0;
+}
+
+/*
+*	Seconds to parse and drop every line, with a fresh cache
+*/
+double run(char const** lines, size_t count, mode how) {
+	parsecache *cache = parsecache_init();
+	parsed_line *line;
+	unsigned int hash;
+	size_t i;
+	double t;
+
+	t = bench_now();
+	for (i = 0; i < count; ++i) {
+		if (how == PARSE) {
+			line = parse_input(lines[i]);
+		} else {
+			/* looks like the second time to the cache */
+			if (how == CACHE_ALL) {
+				hash = strmap_hash(lines[i]);
+				cache->seen[hash & (PARSECACHE_SEEN - 1)] = hash;
+			}
+			line = parse_cached(cache, lines[i]);
+		}
+
+		sink += line->pipec;
+		line_release(line);
+	}
+	t = bench_now() - t;
+
+	parsecache_destroy(cache);
+
+	return t;
+}
@@ -0,0 +1,147 @@
+/*
+*	Bracketed pastes into an interactive psh on a pty, timed from the
+*	paste until the prompt after running it.
+*
+*	paste [psh] [bytes...], default bin/psh and 1024 4096 65536
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+/* what the prompt is set to, to see when psh is ready again */
+#define PROMPT "paste-bench> "
+/* give up on a paste after this long */
+#define TIMEOUT 60.0
+
+bool wait_prompt(int fd, char const* send, size_t len);
+double paste(char const* psh, size_t bytes);
+
+int main(int argc, char* argv[]) {
+	size_t sizes[] = {1024, 4096, 65536};
+	char const *psh = argc > 1 ? argv[1] : "bin/psh";
+	size_t i, bytes;
+	double t;
+
+	for (i = 0; i < (argc > 2 ? (size_t)argc - 2 : 3); ++i) {
+		bytes = argc > 2 ? strtoul(argv[i + 2], NULL, 10) : sizes[i];
+
+		if ((t = paste(psh, bytes)) < 0)
+			printf("%zu byte paste: psh never got back to the prompt\n", bytes);
+		else
+			printf("%zu byte paste: %.1f ms\n", bytes, t * 1e3);
+	}
+
+	return 0;
+}
+
+/*
+*	Pastes an echo of bytes in total and presses enter, -1 if the
+*	prompt never came back
+*/
+double paste(char const* psh, size_t bytes) {
+	static char const start[] = "\033[200~echo ", end[] = "\033[201~\r";
+	struct winsize ws = {.ws_row = 24, .ws_col = 80};
+	char *keys;
+	size_t len = 0, fill;
+	double t = -1;
+	pid_t pid;
+	int fd;
+
+	if ((pid = forkpty(&fd, NULL, NULL, &ws)) < 0) {
+		perror("forkpty");
+		exit(1);
+	}
+
+	if (pid == 0) {
+		/* no history file, and a prompt to look for */
+		unsetenv("HOME");
+		setenv("TERM", "xterm", 1);
+		setenv("PSH_PROMPT", PROMPT, 1);
+		execl(psh, psh, (char*)NULL);
+		perror(psh);
+		_exit(127);
+	}
+
+	fill = bytes > sizeof(start) + sizeof(end) ?
+		bytes - (sizeof(start) - 1) - (sizeof(end) - 1) : 1;
+	keys = malloc(sizeof(start) + fill + sizeof(end));
+	memcpy(keys, start, sizeof(start) - 1);
+	len = sizeof(start) - 1;
+	memset(keys + len, 'x', fill);
+	len += fill;
+	memcpy(keys + len, end, sizeof(end) - 1);
+	len += sizeof(end) - 1;
+
+	if (wait_prompt(fd, NULL, 0)) {
+		t = bench_now();
+		if (wait_prompt(fd, keys, len))
+			t = bench_now() - t;
+		else
+			t = -1;
+	}
+
+	free(keys);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	close(fd);
+
+	return t;
+}
+
+/*
+*	Writes send while reading everything psh prints, until what it
+*	printed last is the prompt
+*/
+bool wait_prompt(int fd, char const* send, size_t len) {
+	char buf[65536], tail[sizeof(PROMPT)] = "";
+	size_t plen = sizeof(PROMPT) - 1, keep;
+	double end = bench_now() + TIMEOUT;
+	struct pollfd pfd = {.fd = fd};
+	ssize_t n;
+
+	while (bench_now() < end) {
+		pfd.events = POLLIN | (len ? POLLOUT : 0);
+		if (poll(&pfd, 1, 100) < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		if (pfd.revents & POLLOUT) {
+			if ((n = write(fd, send, len)) > 0) {
+				send += n;
+				len -= n;
+			}
+		}
+
+		if (pfd.revents & (POLLIN | POLLHUP)) {
+			if ((n = read(fd, buf, sizeof(buf))) <= 0)
+				return false;
+
+			/* the last plen bytes seen, across reads */
+			if ((size_t)n >= plen) {
+				memcpy(tail, buf + n - plen, plen);
+			} else {
+				keep = plen - n;
+				memmove(tail, tail + n, keep);
+				memcpy(tail + keep, buf, n);
+			}
+
+			if (!len && memcmp(tail, PROMPT, plen) == 0)
+				return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+#	A long pipeline of cat, and which fds a stage in the middle of a
+#	pipeline gets.
+#
+#	pipeline.sh [psh] [stages], default bin/psh and 1000
+#
+psh=${1:-bin/psh}
+stages=${2:-1000}
+status=0
+
+line="echo hi"
+i=0
+while [ $i -lt "$stages" ]; do
+	line="$line | cat"
+	i=$((i + 1))
+done
+
+start=$(date +%s%N)
+out=$("$psh" -c "$line")
+end=$(date +%s%N)
+echo "$stages stage pipeline: $(((end - start) / 1000000))ms, printed '$out'"
+[ "$out" = hi ] || status=1
+
+# pipes are closed as the stages start, so this can't run out of fds
+out=$(ulimit -n 64 && "$psh" -c "$line")
+echo "same with ulimit -n 64: printed '$out'"
+[ "$out" = hi ] || status=1
+
+# 0-2 and the directory ls is reading, nothing left over from the
+# other stages' pipes
+fds=$("$psh" -c 'true | ls /proc/self/fd | cat' | tr '\n' ' ')
+echo "fds of a middle stage: $fds"
+[ "$fds" = "0 1 2 3 " ] || status=1
+
+exit $status
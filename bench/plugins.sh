@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+#	A plugin builtin against the program it stands in for: one line of
+#	sum calls from the sample plugin, then the same number of cksum.
+#
+#	plugins.sh [psh] [sample.so] [calls], default bin/psh, bin/sample.so
+#	and 500
+#
+psh=${1:-bin/psh}
+plugin=${2:-bin/sample.so}
+calls=${3:-500}
+
+file=$(mktemp)
+trap 'rm -f "$file"' EXIT
+printf 'some small file to checksum\n' > "$file"
+
+# time of psh -c on a line of $calls copies of $1, in ms
+run() {
+	line="load $plugin;"
+	i=0
+	while [ $i -lt "$calls" ]; do
+		line="$line $1 $file >/dev/null;"
+		i=$((i + 1))
+	done
+
+	start=$(date +%s%N)
+	"$psh" -c "$line" || exit 1
+	end=$(date +%s%N)
+	echo $(((end - start) / 1000000))
+}
+
+sum=$(run sum)
+cksum=$(run cksum)
+echo "$calls calls: plugin sum ${sum}ms, cksum ${cksum}ms"
@@ -1,92 +1,359 @@
+/* for vasprintf */
+#define _GNU_SOURCE
+
 #include "builtin.h"
 
+#include "applets.h"
 #include "shell.h"
 #include "input.h"
 #include "jobs.h"
+#include "parsecache.h"
+#include "history.h"
+#include "cmdhash.h"
+#include "strmap.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
 
-parsed_line* parse_input(history_line* line);
-
-void builtin_cd(int argc, char* argv[]);
-void builtin_history(int argc, char* argv[]);
-void builtin_rerun(int argc, char* argv[]);
+int builtin_cd(builtin_io* io, int argc, char* argv[]);
+int builtin_history(builtin_io* io, int argc, char* argv[]);
+int builtin_rerun(builtin_io* io, int argc, char* argv[]);
+int builtin_hash(builtin_io* io, int argc, char* argv[]);
+int builtin_load(builtin_io* io, int argc, char* argv[]);
+int builtin_exit(builtin_io* io, int argc, char* argv[]);
+void free_builtin(void* value);
 
 static const builtin builtins[] = {
 	{"cd", builtin_cd},
 	{"history", builtin_history},
 	{"!", builtin_rerun},
+	{"hash", builtin_hash},
+	{"load", builtin_load},
+	{"exit", builtin_exit},
+	{"echo", applet_echo},
+	{"true", applet_true},
+	{"false", applet_false},
+	{"test", applet_test},
+	{"[", applet_test},
+	{"printf", applet_printf},
+	{"pwd", applet_pwd},
+	{"basename", applet_basename},
 	{NULL, NULL}
 };
 
-/* TODO: implement this with a hashmap */
-builtin const* builtin_get(char const* name) {
-	int i = 0;
-	builtin const *ret = NULL;
+/* name -> builtin, everything callable goes through here */
+static strmap *table = NULL;
+
+/* loaded plugins, only closed once nothing can call into them */
+static void **plugins = NULL;
+static int pluginc = 0;
+
+void builtin_init(void) {
 	builtin const *bin;
 
-	bin = &builtins[i];
-	while(bin->name && bin->func) {
-		if (strcmp(bin->name, name) == 0) {
-			ret = bin;
-		}
-		bin = &builtins[++i];
+	table = strmap_init();
+
+	for (bin = builtins; bin->name; ++bin) {
+		builtin_register(bin->name, bin->func);
 	}
+}
+
+void free_builtin(void* value) {
+	builtin *bin = value;
 
-	return ret;
+	free((char*)bin->name);
+	free(bin);
 }
 
-void builtin_cd(int argc, char* argv[]) {
+void builtin_destroy(void) {
+	int i;
+
+	if (!table)
+		return;
+
+	strmap_destroy(table, &free_builtin);
+	table = NULL;
+
+	for (i = 0; i < pluginc; ++i)
+		dlclose(plugins[i]);
+	free(plugins);
+	plugins = NULL;
+	pluginc = 0;
+}
+
+/*
+*	Adds a builtin, replacing any earlier one with the same name
+*/
+void builtin_register(char const* name, builtin_func* func) {
+	builtin *bin = malloc(sizeof(builtin));
+	builtin *old;
+
+	bin->name = strdup(name);
+	bin->func = func;
+
+	if ((old = strmap_put(table, name, bin)))
+		free_builtin(old);
+}
+
+builtin const* builtin_get(char const* name) {
+	return strmap_get(table, name);
+}
+
+void io_init(builtin_io* io, int in, int out) {
+	io->in = in;
+	io->out = out;
+	io->len = 0;
+}
+
+void io_write(builtin_io* io, char const* s, size_t len) {
+	ssize_t n;
+
+	if (io->len + len > BUILTIN_IO_SIZE)
+		io_flush(io);
+
+	if (len <= BUILTIN_IO_SIZE) {
+		memcpy(io->buf + io->len, s, len);
+		io->len += len;
+		return;
+	}
+
+	/* too big to bother buffering */
+	while (len > 0) {
+		n = write(io->out, s, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return;
+		s += n;
+		len -= n;
+	}
+}
+
+void io_printf(builtin_io* io, char const* fmt, ...) {
+	va_list args;
+	char *big;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(io->buf + io->len, BUILTIN_IO_SIZE - io->len,
+		fmt, args);
+	va_end(args);
+
+	if (len < 0 || io->len + len < BUILTIN_IO_SIZE) {
+		if (len > 0)
+			io->len += len;
+		return;
+	}
+
+	/* didn't fit, whatever did get in is thrown away */
+	va_start(args, fmt);
+	len = vasprintf(&big, fmt, args);
+	va_end(args);
+
+	if (len < 0)
+		return;
+
+	io_write(io, big, len);
+	free(big);
+}
+
+void io_flush(builtin_io* io) {
+	size_t off = 0;
+	ssize_t n;
+
+	while (off < io->len) {
+		n = write(io->out, io->buf + off, io->len - off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			break;
+		off += n;
+	}
+
+	io->len = 0;
+}
+
+int builtin_cd(builtin_io* io, int argc, char* argv[]) {
 	char *dir = getenv("HOME");
 
+	UNUSED(io);
+
 	if (argc > 1) {
 		dir = argv[1];
 	}
 
-	if (chdir(dir) == -1) {
+	if (!dir)
+		return 1;
+
+	if (!shell_chdir(psh, dir)) {
 		perror("PSH");
+		return 1;
 	}
+
+	return 0;
 }
 
-void builtin_history(int argc, char* argv[]) {
+int builtin_history(builtin_io* io, int argc, char* argv[]) {
 	UNUSED(argc);
 	UNUSED(argv);
-	int i = 0;
-	history_line *hist = psh->input->history_first;
+	size_t i;
+	history *hist;
+
+	if (!psh->interactive) {
+		fprintf(stderr, "psh: history: only in interactive shells\n");
+		return 1;
+	}
+	hist = psh->input->history;
+
+	/* include what other sessions have run since */
+	history_sync(hist);
 
-	while (hist && hist->next) {
-		printf("%02d: %s\n", ++i, hist->buffer);
-		hist = hist->next;
+	for (i = 0; i < history_count(hist); ++i) {
+		io_printf(io, "%02zu: %s\n", i + 1, history_get(hist, i));
 	}
+
+	return 0;
 }
 
-void builtin_rerun(int argc, char* argv[]) {
-	int i = 0;
+int builtin_rerun(builtin_io* io, int argc, char* argv[]) {
 	int in;
 	parsed_line* line;
-	history_line *hist = psh->input->history_first;
+	history *hist;
+
+	UNUSED(io);
+
+	if (!psh->interactive) {
+		fprintf(stderr, "psh: !: only in interactive shells\n");
+		return 1;
+	}
+	hist = psh->input->history;
 
 	if (argc <= 1) {
 		fprintf(stderr, "not enough arguments\n");
-		return;
+		return 1;
 	}
 
 	in = atoi(argv[1]);
 
-	while (hist && hist != psh->input->history_current->prev) {
-		if (++i == in) {
-			/* last minute hacks yaaay */
-			/* please never actually do this */
-			line = parse_input(hist);
-			if (line->cmdc == 0)
-				return;
+	/* the last entry is this "! n" itself */
+	if (in < 1 || (size_t)in >= history_count(hist))
+		return 1;
 
-			jobs_process(psh->jobs, line);
-			return;
+	/* rerunning the same entry again skips parsing it */
+	line = parse_cached(psh->parsed, history_get(hist, in - 1));
+	if (line->pipec == 0) {
+		line_release(line);
+		return 0;
+	}
+
+	jobs_process(psh->jobs, line);
+
+	return psh->jobs->status;
+}
+
+void print_hash(char const* name, void* value, void* data) {
+	cmdhash_entry *e = value;
+
+	UNUSED(name);
+
+	io_printf(data, "%4d\t%s\n", e->hits, e->path);
+}
+
+/*
+*	hash: list remembered commands
+*	hash -r: forget them
+*	hash name...: look names up and remember them
+*/
+int builtin_hash(builtin_io* io, int argc, char* argv[]) {
+	cmdhash *hash = psh->jobs->hash;
+	int i, status = 0;
+
+	if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+		cmdhash_clear(hash);
+		return 0;
+	}
+
+	if (argc > 1) {
+		for (i = 1; i < argc; ++i) {
+			if (!cmdhash_peek(hash, argv[i])) {
+				fprintf(stderr, "psh: hash: %s: not found\n", argv[i]);
+				status = 1;
+			}
 		}
-		hist = hist->next;
+		return status;
 	}
+
+	if (hash->cmds->count == 0) {
+		io_printf(io, "hash: hash table empty\n");
+		return 0;
+	}
+
+	io_printf(io, "hits\tcommand\n");
+	strmap_foreach(hash->cmds, &print_hash, io);
+
+	return 0;
+}
+
+/*
+*	load file.so...: adds the builtins a plugin exports as
+*	psh_builtins, a builtin[] ending in {NULL, NULL}. Plugins call back
+*	into the shell for io_printf and friends, so psh is linked with
+*	-rdynamic.
+*/
+int builtin_load(builtin_io* io, int argc, char* argv[]) {
+	builtin const *bin;
+	void *handle;
+	int i, status = 0;
+
+	UNUSED(io);
+
+	if (argc <= 1) {
+		fprintf(stderr, "psh: load: not enough arguments\n");
+		return 1;
+	}
+
+	for (i = 1; i < argc; ++i) {
+		if (!(handle = dlopen(argv[i], RTLD_NOW | RTLD_LOCAL))) {
+			fprintf(stderr, "psh: load: %s\n", dlerror());
+			status = 1;
+			continue;
+		}
+
+		if (!(bin = dlsym(handle, PLUGIN_SYMBOL))) {
+			fprintf(stderr, "psh: load: %s: no %s\n", argv[i],
+				PLUGIN_SYMBOL);
+			dlclose(handle);
+			status = 1;
+			continue;
+		}
+
+		for (; bin->name; ++bin)
+			builtin_register(bin->name, bin->func);
+
+		plugins = realloc(plugins, sizeof(void*) * (pluginc + 1));
+		plugins[pluginc++] = handle;
+	}
+
+	return status;
+}
+
+/*
+*	exit [n]: the shell stops once this line is done with, which
+*	skips the rest of it. In a pipeline or the background only that
+*	forked copy exits.
+*/
+int builtin_exit(builtin_io* io, int argc, char* argv[]) {
+	UNUSED(io);
+
+	psh->running = false;
+
+	if (argc > 1)
+		return atoi(argv[1]) & 0xff;
+
+	return psh->jobs->status;
 }
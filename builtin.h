@@ -1,15 +1,48 @@
 #ifndef _BIN_GUARD
 #define _BIN_GUARD
 
+#include <stddef.h>
+
 /* builtin stuff */
 
-typedef void(builtin_func)(int argc, char* argv[]);
+/* output a builtin can have buffered before it gets written out */
+#define BUILTIN_IO_SIZE 4096
+
+/*
+*	Where a builtin reads and writes, the terminal or whatever it was
+*	redirected to. Output goes through io_printf and io_write and is
+*	written out in as few writes as possible. Errors go straight to
+*	stderr, which can't be redirected.
+*/
+typedef struct builtin_io {
+	int in;
+	int out;
+
+	char buf[BUILTIN_IO_SIZE];
+	size_t len;
+} builtin_io;
+
+/* returns the exit status, like a program would */
+typedef int(builtin_func)(builtin_io* io, int argc, char* argv[]);
 
 typedef struct builtin {
 	char const* name;
 	builtin_func* func;
 } builtin;
 
+/* what a plugin exports for load, NULL terminated like builtins[] */
+#define PLUGIN_SYMBOL "psh_builtins"
+
+void builtin_init(void);
+void builtin_destroy(void);
+
+void builtin_register(char const* name, builtin_func* func);
 builtin const* builtin_get(char const* name);
 
+void io_init(builtin_io* io, int in, int out);
+void io_write(builtin_io* io, char const* s, size_t len);
+void io_printf(builtin_io* io, char const* fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+void io_flush(builtin_io* io);
+
 #endif
@@ -0,0 +1,217 @@
+#include "cmdhash.h"
+
+#include "strmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* what execvp uses when there's no $PATH */
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+void set_path(cmdhash* hash, char const* path);
+void free_dirs(cmdhash* hash);
+bool dir_changed(path_dir* dir);
+char const* lookup(cmdhash* hash, char const* name, bool hit);
+char const* search(cmdhash* hash, char const* name, bool hit);
+void free_entry(void* entry);
+
+/*
+*	Public functions
+*/
+
+cmdhash* cmdhash_init(void) {
+	cmdhash *hash = malloc(sizeof(cmdhash));
+
+	hash->cmds = strmap_init();
+	hash->path_env = NULL;
+	hash->dirs = NULL;
+	hash->dirc = 0;
+
+	return hash;
+}
+
+void cmdhash_destroy(cmdhash* hash) {
+	strmap_destroy(hash->cmds, &free_entry);
+	free_dirs(hash);
+	free(hash);
+}
+
+/*
+*	Resolves a command name to the file that would get executed, or
+*	NULL if it's nowhere in $PATH. The result is valid until the next call.
+*/
+char const* cmdhash_find(cmdhash* hash, char const* name) {
+	return lookup(hash, name, true);
+}
+
+/*
+*	Like cmdhash_find, for the shell's own lookups of a command it
+*	isn't about to run
+*/
+char const* cmdhash_peek(cmdhash* hash, char const* name) {
+	return lookup(hash, name, false);
+}
+
+void cmdhash_clear(cmdhash* hash) {
+	strmap_clear(hash->cmds, &free_entry);
+}
+
+/*
+*	Private functions
+*/
+
+/*
+*	Finds name in $PATH, remembering where. hit is whether it counts
+*	towards the hits hash shows.
+*/
+char const* lookup(cmdhash* hash, char const* name, bool hit) {
+	char const *path = getenv("PATH");
+	cmdhash_entry *e;
+	int i;
+
+	/* not a $PATH lookup */
+	if (strchr(name, '/'))
+		return name;
+
+	if (!path)
+		path = DEFAULT_PATH;
+
+	if (!hash->path_env || strcmp(path, hash->path_env) != 0)
+		set_path(hash, path);
+
+	if ((e = strmap_get(hash->cmds, name))) {
+		/* a new file in any dir up to the one it was found in could
+		 * shadow it, and it could be gone from its own dir */
+		for (i = 0; i <= e->dir; ++i) {
+			if (dir_changed(&hash->dirs[i])) {
+				cmdhash_clear(hash);
+				return search(hash, name, hit);
+			}
+		}
+
+		if (hit)
+			++e->hits;
+		return e->path;
+	}
+
+	return search(hash, name, hit);
+}
+
+void set_path(cmdhash* hash, char const* path) {
+	char const *start = path;
+	char const *end;
+	int n = 1;
+
+	cmdhash_clear(hash);
+	free_dirs(hash);
+
+	while ((end = strchr(start, ':'))) {
+		++n;
+		start = end + 1;
+	}
+
+	hash->path_env = strdup(path);
+	hash->dirs = malloc(sizeof(path_dir) * n);
+	hash->dirc = n;
+
+	start = path;
+	for (n = 0; n < hash->dirc; ++n) {
+		end = strchr(start, ':');
+		if (!end)
+			end = start + strlen(start);
+
+		/* empty entry means cwd */
+		if (end == start)
+			hash->dirs[n].name = strdup(".");
+		else
+			hash->dirs[n].name = strndup(start, end - start);
+
+		/* not looked at yet */
+		hash->dirs[n].mtime.tv_sec = 0;
+		hash->dirs[n].mtime.tv_nsec = -1;
+
+		start = end + 1;
+	}
+}
+
+void free_dirs(cmdhash* hash) {
+	int i;
+
+	for (i = 0; i < hash->dirc; ++i) {
+		free(hash->dirs[i].name);
+	}
+
+	free(hash->dirs);
+	free(hash->path_env);
+	hash->dirs = NULL;
+	hash->path_env = NULL;
+	hash->dirc = 0;
+}
+
+/*
+*	Has anything been added to or removed from dir since we last looked?
+*/
+bool dir_changed(path_dir* dir) {
+	struct stat st;
+	bool seen = dir->mtime.tv_nsec != -1;
+
+	if (stat(dir->name, &st) < 0) {
+		/* missing dirs count as a fixed, never seen before mtime */
+		st.st_mtim.tv_sec = 0;
+		st.st_mtim.tv_nsec = -2;
+	}
+
+	if (dir->mtime.tv_sec == st.st_mtim.tv_sec &&
+		dir->mtime.tv_nsec == st.st_mtim.tv_nsec)
+		return false;
+
+	dir->mtime = st.st_mtim;
+	return seen;
+}
+
+/*
+*	Walks $PATH like execvp would, and remembers the result
+*/
+char const* search(cmdhash* hash, char const* name, bool hit) {
+	cmdhash_entry *e;
+	struct stat st;
+	int i;
+
+	for (i = 0; i < hash->dirc; ++i) {
+		/* the cache assumes dirs we've looked at haven't changed */
+		if (dir_changed(&hash->dirs[i]))
+			cmdhash_clear(hash);
+
+		snprintf(hash->found, sizeof(hash->found), "%s/%s",
+			hash->dirs[i].name, name);
+
+		if (stat(hash->found, &st) < 0 || !S_ISREG(st.st_mode) ||
+			access(hash->found, X_OK) < 0)
+			continue;
+
+		/* relative to cwd, can't be remembered */
+		if (hash->dirs[i].name[0] != '/')
+			return hash->found;
+
+		e = malloc(sizeof(cmdhash_entry));
+		e->path = strdup(hash->found);
+		e->dir = i;
+		e->hits = hit ? 1 : 0;
+		strmap_put(hash->cmds, name, e);
+
+		return e->path;
+	}
+
+	return NULL;
+}
+
+void free_entry(void* entry) {
+	cmdhash_entry *e = entry;
+
+	free(e->path);
+	free(e);
+}
@@ -0,0 +1,43 @@
+#ifndef _CMDHASH_GUARD
+#define _CMDHASH_GUARD
+
+#include <time.h>
+#include <linux/limits.h>
+
+struct strmap;
+
+/* a $PATH entry and its mtime when we last looked into it */
+typedef struct path_dir {
+	char* name;
+	struct timespec mtime;
+} path_dir;
+
+/* a remembered command */
+typedef struct cmdhash_entry {
+	char* path;
+	/* index of the $PATH dir it was found in */
+	int dir;
+	int hits;
+} cmdhash_entry;
+
+/* command name -> absolute path cache, like bash's hash */
+typedef struct cmdhash {
+	struct strmap* cmds;
+
+	/* $PATH the cache was built for */
+	char* path_env;
+	path_dir* dirs;
+	int dirc;
+
+	/* results that can't be cached (relative $PATH entries) */
+	char found[PATH_MAX];
+} cmdhash;
+
+cmdhash* cmdhash_init(void);
+void cmdhash_destroy(cmdhash* hash);
+
+char const* cmdhash_find(cmdhash* hash, char const* name);
+char const* cmdhash_peek(cmdhash* hash, char const* name);
+void cmdhash_clear(cmdhash* hash);
+
+#endif
@@ -0,0 +1,317 @@
+#include "display.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+
+/* for when the terminal won't say */
+#define DEFAULT_COLS 80
+
+void set_text(display_text* t, char const* prompt, char const* line,
+	size_t len, char const* ghost, size_t ghost_len);
+void draw(display* d, size_t from);
+void move_to(display* d, size_t col);
+size_t width(display* d, char const* s, size_t len);
+void put_text(display* d, char const* s, size_t from, size_t to);
+int get_cols(void);
+void put(display* d, char const* s, size_t len);
+void put_fmt(display* d, char const* fmt, ...);
+void flush(display* d);
+
+/*
+*	Public functions
+*/
+
+display* display_init(void) {
+	sigset_t mask;
+	display *d = malloc(sizeof(display));
+
+	memset(d, 0, sizeof(display));
+	d->cols = get_cols();
+
+	/* picked up from the main loop like SIGCHLD */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGWINCH);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	d->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (d->sigfd < 0) {
+		perror("psh: signalfd");
+		free(d);
+		return NULL;
+	}
+
+	return d;
+}
+
+void display_destroy(display* d) {
+	close(d->sigfd);
+	free(d->shown.s);
+	free(d->next.s);
+	free(d->out);
+	free(d);
+}
+
+/*
+*	The cursor is at the start of a fresh line with nothing on it,
+*	e.g. after a command's output
+*/
+void display_reset(display* d) {
+	d->shown.len = d->shown.ghost = 0;
+	d->at = d->cur = 0;
+}
+
+/*
+*	Makes the screen show prompt, line and the greyed out ghost after
+*	it, with the cursor at byte cursor of line
+*/
+void display_update(display* d, char const* prompt, char const* line,
+	size_t len, size_t cursor, char const* ghost, size_t ghost_len) {
+
+	display_text *old = &d->shown, *new = &d->next, tmp;
+	size_t p = 0;
+
+	set_text(new, prompt, line, len, ghost, ghost_len);
+	d->cur = width(d, new->s, new->ghost - len + cursor);
+
+	/* unchanged start of the screen */
+	while (p < old->len && p < new->len && old->s[p] == new->s[p])
+		++p;
+
+	/* same text but greyed out or not */
+	if (old->ghost != new->ghost) {
+		if (p > old->ghost)
+			p = old->ghost;
+		if (p > new->ghost)
+			p = new->ghost;
+	}
+
+	if (p < old->len || p < new->len)
+		draw(d, p);
+
+	tmp = *old;
+	*old = *new;
+	*new = tmp;
+
+	move_to(d, d->cur);
+	flush(d);
+}
+
+/*
+*	Leaves the line for whatever runs next, below everything that
+*	was drawn
+*/
+void display_newline(display* d) {
+	move_to(d, width(d, d->shown.s, d->shown.len));
+
+	/* already wrapped onto a new row */
+	if (d->at == 0 || d->at % d->cols != 0)
+		put(d, "\r\n", 2);
+
+	flush(d);
+	display_reset(d);
+}
+
+/*
+*	New terminal width. How the terminal rewrapped what was there is
+*	anyone's guess, so go back up to where the prompt should start and
+*	draw it all again.
+*/
+void display_resize(display* d) {
+	display_text tmp;
+	int cols = get_cols();
+
+	if (cols == d->cols)
+		return;
+
+	d->cols = cols;
+	put(d, "\r", 1);
+	if (d->at / cols)
+		put_fmt(d, "\033[%zuA", d->at / cols);
+	put(d, "\033[J", 3);
+	d->at = 0;
+
+	/* draw against an empty screen */
+	tmp = d->next;
+	d->next = d->shown;
+	d->shown = tmp;
+	d->shown.len = d->shown.ghost = 0;
+
+	draw(d, 0);
+
+	tmp = d->next;
+	d->next = d->shown;
+	d->shown = tmp;
+
+	move_to(d, d->cur);
+	flush(d);
+}
+
+/*
+*	Private functions
+*/
+
+void set_text(display_text* t, char const* prompt, char const* line,
+	size_t len, char const* ghost, size_t ghost_len) {
+
+	size_t plen = strlen(prompt);
+	size_t need = plen + len + ghost_len;
+
+	if (need > t->cap) {
+		t->cap = need * 2;
+		t->s = realloc(t->s, t->cap);
+	}
+
+	memcpy(t->s, prompt, plen);
+	memcpy(t->s + plen, line, len);
+	if (ghost_len)
+		memcpy(t->s + plen + len, ghost, ghost_len);
+
+	t->ghost = plen + len;
+	t->len = need;
+}
+
+/* rewrites next from byte from on, clearing whatever shown had past it */
+void draw(display* d, size_t from) {
+	display_text *old = &d->shown, *new = &d->next;
+	size_t end = width(d, new->s, new->len);
+
+	move_to(d, width(d, new->s, from));
+
+	if (from < new->ghost)
+		put_text(d, new->s, from, new->ghost);
+
+	if (new->len > new->ghost) {
+		if (from < new->ghost)
+			from = new->ghost;
+		put(d, "\033[90m", 5);
+		put_text(d, new->s, from, new->len);
+		put(d, "\033[0m", 4);
+	}
+
+	/* the terminal holds off wrapping after the last column until
+	 * something else is written, make it actually go there */
+	if (end > d->at && end % d->cols == 0)
+		put(d, "\r\n", 2);
+	d->at = end;
+
+	if (width(d, old->s, old->len) > end)
+		put(d, "\033[J", 3);
+}
+
+/* CHA for the column, rows can only be relative */
+void move_to(display* d, size_t col) {
+	size_t from = d->at / d->cols;
+	size_t to = col / d->cols;
+
+	if (col == d->at)
+		return;
+
+	if (to < from)
+		put_fmt(d, "\033[%zuA", from - to);
+	else if (to > from)
+		put_fmt(d, "\033[%zuB", to - from);
+
+	put_fmt(d, "\033[%zuG", col % d->cols + 1);
+	d->at = col;
+}
+
+/*
+*	Columns taken up by s, UTF-8 continuation bytes don't count and a
+*	newline takes up the rest of its row
+*/
+size_t width(display* d, char const* s, size_t len) {
+	size_t i, w = 0;
+
+	for (i = 0; i < len; ++i) {
+		if (s[i] == '\n')
+			w += d->cols - w % d->cols;
+		else if (((unsigned char)s[i] & 0xc0) != 0x80)
+			++w;
+	}
+
+	return w;
+}
+
+/*
+*	Bytes from..to of s. A newline goes out as blanks to the end of
+*	its row, so the terminal wraps after it just like after text.
+*/
+void put_text(display* d, char const* s, size_t from, size_t to) {
+	static char const blanks[] = "                                ";
+	size_t w = width(d, s, from), pad, n;
+	char const *nl;
+
+	while ((nl = memchr(s + from, '\n', to - from))) {
+		n = nl - (s + from);
+		put(d, s + from, n);
+		w += width(d, s + from, n);
+
+		for (pad = d->cols - w % d->cols; pad > 0; pad -= n) {
+			n = pad < sizeof(blanks) - 1 ? pad : sizeof(blanks) - 1;
+			put(d, blanks, n);
+			w += n;
+		}
+
+		from = nl - s + 1;
+	}
+
+	put(d, s + from, to - from);
+}
+
+int get_cols(void) {
+	struct winsize ws;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0 || ws.ws_col == 0)
+		return DEFAULT_COLS;
+
+	return ws.ws_col;
+}
+
+void put(display* d, char const* s, size_t len) {
+	if (d->out_len + len > d->out_cap) {
+		d->out_cap = (d->out_len + len) * 2;
+		d->out = realloc(d->out, d->out_cap);
+	}
+
+	memcpy(d->out + d->out_len, s, len);
+	d->out_len += len;
+}
+
+void put_fmt(display* d, char const* fmt, ...) {
+	char buf[32];
+	va_list args;
+	int n;
+
+	va_start(args, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	put(d, buf, n);
+}
+
+/* everything queued up, in one write */
+void flush(display* d) {
+	size_t done = 0;
+	ssize_t n;
+
+	/* anything printed normally goes first */
+	fflush(stdout);
+
+	while (done < d->out_len) {
+		n = write(STDOUT_FILENO, d->out + done, d->out_len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			break;
+		done += n;
+	}
+
+	d->out_len = 0;
+}
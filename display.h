@@ -0,0 +1,47 @@
+#ifndef _DISPLAY_GUARD
+#define _DISPLAY_GUARD
+
+#include <stddef.h>
+
+/* prompt and line as one string, the suggestion after ghost */
+typedef struct display_text {
+	char* s;
+	size_t len;
+	size_t cap;
+	size_t ghost;
+} display_text;
+
+/*
+*	Keeps track of what the edited line looks like on screen, so a
+*	redraw only sends what changed, in a single write. Positions are
+*	columns counted from the start of the prompt, rows come from the
+*	terminal width. A newline in the line fills the rest of its row.
+*/
+typedef struct display {
+	int cols;
+	/* SIGWINCH, for the main loop */
+	int sigfd;
+
+	display_text shown;
+	display_text next;
+
+	/* where the terminal cursor is, and where it should end up */
+	size_t at;
+	size_t cur;
+
+	/* escapes and text for one redraw */
+	char* out;
+	size_t out_len;
+	size_t out_cap;
+} display;
+
+display* display_init(void);
+void display_destroy(display* d);
+
+void display_reset(display* d);
+void display_update(display* d, char const* prompt, char const* line,
+	size_t len, size_t cursor, char const* ghost, size_t ghost_len);
+void display_newline(display* d);
+void display_resize(display* d);
+
+#endif
@@ -0,0 +1,176 @@
+#include "event.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define MAX_EVENTS 16
+
+event_handler* add_handler(event_loop* ev, int fd, event_func* func,
+	void* data);
+void free_dead(event_loop* ev);
+
+/*
+*	Public functions
+*/
+
+event_loop* event_init(void) {
+	event_loop *ev = malloc(sizeof(event_loop));
+
+	ev->first_handler = NULL;
+	ev->epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (ev->epoll < 0) {
+		perror("psh: epoll");
+		free(ev);
+		return NULL;
+	}
+
+	return ev;
+}
+
+void event_destroy(event_loop* ev) {
+	event_handler *h, *next;
+
+	for (h = ev->first_handler; h; h = next) {
+		next = h->next;
+		if (h->timer)
+			close(h->fd);
+		free(h);
+	}
+
+	close(ev->epoll);
+	free(ev);
+}
+
+/*
+*	Watches fd for input, func gets called from event_wait
+*/
+bool event_add(event_loop* ev, int fd, event_func* func, void* data) {
+	return add_handler(ev, fd, func, data) != NULL;
+}
+
+void event_remove(event_loop* ev, int fd) {
+	event_handler *h;
+
+	for (h = ev->first_handler; h; h = h->next) {
+		if (h->fd == fd && !h->dead) {
+			epoll_ctl(ev->epoll, EPOLL_CTL_DEL, fd, NULL);
+			h->dead = true;
+			return;
+		}
+	}
+}
+
+/*
+*	One-shot timer, calls func once after ms milliseconds
+*/
+bool event_timer(event_loop* ev, int ms, event_func* func, void* data) {
+	event_handler *h;
+	struct itimerspec spec = {{0, 0}, {0, 0}};
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (fd < 0) {
+		perror("psh: timer");
+		return false;
+	}
+
+	spec.it_value.tv_sec = ms / 1000;
+	spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+	/* zero would disarm it */
+	if (!ms)
+		spec.it_value.tv_nsec = 1;
+
+	if (timerfd_settime(fd, 0, &spec, NULL) < 0 ||
+		!(h = add_handler(ev, fd, func, data))) {
+		perror("psh: timer");
+		close(fd);
+		return false;
+	}
+	h->timer = true;
+
+	return true;
+}
+
+/*
+*	Sleeps until something happens and dispatches it.
+*	No timeouts here, the shell only wakes up when it has work to do.
+*/
+void event_wait(event_loop* ev) {
+	struct epoll_event events[MAX_EVENTS];
+	event_handler *h;
+	uint64_t expired;
+	int i, n;
+
+	n = epoll_wait(ev->epoll, events, MAX_EVENTS, -1);
+	if (n < 0) {
+		if (errno != EINTR)
+			perror("psh: epoll_wait");
+		return;
+	}
+
+	for (i = 0; i < n; ++i) {
+		h = events[i].data.ptr;
+		if (h->dead)
+			continue;
+
+		if (h->timer) {
+			if (read(h->fd, &expired, sizeof(expired)) < 0)
+				continue;
+			event_remove(ev, h->fd);
+			close(h->fd);
+		}
+
+		h->func(h->fd, h->data);
+	}
+
+	free_dead(ev);
+}
+
+/*
+*	Private functions
+*/
+
+event_handler* add_handler(event_loop* ev, int fd, event_func* func,
+	void* data) {
+
+	struct epoll_event event;
+	event_handler *h = malloc(sizeof(event_handler));
+
+	h->fd = fd;
+	h->func = func;
+	h->data = data;
+	h->timer = false;
+	h->dead = false;
+
+	event.events = EPOLLIN;
+	event.data.ptr = h;
+	if (epoll_ctl(ev->epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+		perror("psh: epoll_ctl");
+		free(h);
+		return NULL;
+	}
+
+	h->next = ev->first_handler;
+	ev->first_handler = h;
+
+	return h;
+}
+
+void free_dead(event_loop* ev) {
+	event_handler **h = &ev->first_handler;
+	event_handler *dead;
+
+	while (*h) {
+		if ((*h)->dead) {
+			dead = *h;
+			*h = dead->next;
+			free(dead);
+		} else {
+			h = &(*h)->next;
+		}
+	}
+}
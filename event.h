@@ -0,0 +1,38 @@
+#ifndef _EVENT_GUARD
+#define _EVENT_GUARD
+
+#include <stdbool.h>
+
+/* called from event_wait when fd is readable */
+typedef void(event_func)(int fd, void* data);
+
+typedef struct event_handler {
+	struct event_handler* next;
+
+	int fd;
+	event_func* func;
+	void* data;
+
+	/* one-shot timerfd, closed after it fires */
+	bool timer;
+	/* removed while dispatching, freed after the batch */
+	bool dead;
+} event_handler;
+
+typedef struct event_loop {
+	int epoll;
+
+	event_handler* first_handler;
+} event_loop;
+
+event_loop* event_init(void);
+void event_destroy(event_loop* ev);
+
+bool event_add(event_loop* ev, int fd, event_func* func, void* data);
+void event_remove(event_loop* ev, int fd);
+
+bool event_timer(event_loop* ev, int ms, event_func* func, void* data);
+
+void event_wait(event_loop* ev);
+
+#endif
@@ -0,0 +1,306 @@
+/* for CLONE_PARENT */
+#define _GNU_SOURCE
+
+#include "forksrv.h"
+
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+bool forksrv_send(int sock, void const* buf, size_t len);
+bool forksrv_recv(int sock, void* buf, size_t len);
+void forksrv_launch(forksrv_request* req, char* data, int in, int out)
+	__attribute__ ((noreturn));
+char* pack_strings(char const* path, char* argv[], int* argc, int* envc,
+	size_t* len);
+
+/*
+*	Public functions
+*/
+
+/*
+*	Runs psh again as the server, NULL if that didn't work out
+*/
+forksrv* forksrv_start(void) {
+	forksrv *srv;
+	pid_t pid;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+		perror("psh: forkserver");
+		return NULL;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("psh: forkserver");
+		close(sv[0]);
+		close(sv[1]);
+		return NULL;
+	}
+
+	if (pid == 0) {
+		/* dup2 onto itself would leave close-on-exec set */
+		if (sv[1] == FORKSRV_FD)
+			fcntl(sv[1], F_SETFD, 0);
+		else if (dup2(sv[1], FORKSRV_FD) < 0)
+			_exit(EXIT_FAILURE);
+
+		execl("/proc/self/exe", "psh", FORKSRV_ARG, (char*)NULL);
+		perror("psh: forkserver");
+		_exit(EXIT_FAILURE);
+	}
+
+	close(sv[1]);
+
+	srv = malloc(sizeof(forksrv));
+	srv->pid = pid;
+	srv->sock = sv[0];
+	srv->dead = false;
+
+	return srv;
+}
+
+/*
+*	The server goes away by itself once its socket closes
+*/
+void forksrv_stop(forksrv* srv) {
+	close(srv->sock);
+	waitpid(srv->pid, NULL, 0);
+	free(srv);
+}
+
+/*
+*	Asks the server to start path, same as launch_process would. Returns
+*	the pid or -1 with errno set. If the server is gone srv->dead gets
+*	set and nothing was started.
+*/
+pid_t forksrv_spawn(forksrv* srv, char const* path, char* argv[],
+	pid_t pgid, int term, int in, int out, bool foreground) {
+
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * 2)];
+	} ctl;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	forksrv_request req;
+	forksrv_reply rep;
+	char *data;
+	int fds[2] = {in, out};
+
+	req.pgid = pgid;
+	req.term = term;
+	req.foreground = foreground;
+	data = pack_strings(path, argv, &req.argc, &req.envc, &req.len);
+
+	iov.iov_base = &req;
+	iov.iov_len = sizeof(req);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(srv->sock, &msg, MSG_NOSIGNAL) != sizeof(req) ||
+		!forksrv_send(srv->sock, data, req.len) ||
+		!forksrv_recv(srv->sock, &rep, sizeof(rep))) {
+
+		perror("psh: forkserver");
+		srv->dead = true;
+		free(data);
+		return -1;
+	}
+
+	free(data);
+
+	if (rep.pid < 0)
+		errno = rep.err;
+
+	return rep.pid;
+}
+
+/*
+*	main for psh FORKSRV_ARG, starts whatever the shell asks for until
+*	the shell goes away
+*/
+int forksrv_main(void) {
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * 2)];
+	} ctl;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	forksrv_request req;
+	forksrv_reply rep;
+	char *data;
+	int sock = FORKSRV_FD;
+	int fds[2];
+	ssize_t n;
+
+	/* children shouldn't get it */
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+	/* or ps calls us exe */
+	prctl(PR_SET_NAME, "psh-forksrv");
+
+	for (;;) {
+		iov.iov_base = &req;
+		iov.iov_len = sizeof(req);
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = ctl.buf;
+		msg.msg_controllen = sizeof(ctl.buf);
+
+		n = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n != sizeof(req))
+			break;
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+			cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+			break;
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+		data = malloc(req.len);
+		if (!forksrv_recv(sock, data, req.len))
+			break;
+
+		/* like fork, but the child's parent is the shell */
+		rep.pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
+		rep.err = errno;
+		if (rep.pid == 0)
+			forksrv_launch(&req, data, fds[0], fds[1]);
+
+		close(fds[0]);
+		close(fds[1]);
+		free(data);
+
+		if (!forksrv_send(sock, &rep, sizeof(rep)))
+			break;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+*	Private functions
+*/
+
+bool forksrv_send(int sock, void const* buf, size_t len) {
+	char const *s = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(sock, s, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		s += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+bool forksrv_recv(int sock, void* buf, size_t len) {
+	char *s = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = recv(sock, s, len, MSG_WAITALL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			/* EOF isn't an error to perror, but it's still the end */
+			if (n == 0)
+				errno = ECONNRESET;
+			return false;
+		}
+		s += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/*
+*	In the cloned child, unpacks the request and runs it
+*/
+void forksrv_launch(forksrv_request* req, char* data, int in, int out) {
+	char **argv = malloc(sizeof(char*) * (req->argc + req->envc + 2));
+	char **env = argv + req->argc + 1;
+	char *path = data;
+	int i;
+
+	data += strlen(data) + 1;
+	for (i = 0; i < req->argc; ++i) {
+		argv[i] = data;
+		data += strlen(data) + 1;
+	}
+	argv[req->argc] = NULL;
+
+	for (i = 0; i < req->envc; ++i) {
+		env[i] = data;
+		data += strlen(data) + 1;
+	}
+	env[req->envc] = NULL;
+
+	jobs_setup_child(req->pgid, req->term, in, out, req->foreground);
+
+	execve(path, argv, env);
+	perror("psh: exec");
+	_exit(EXIT_FAILURE);
+}
+
+/*
+*	path, argv and the shell's environ as one buffer for the server,
+*	environ goes too since cd changes $PWD
+*/
+char* pack_strings(char const* path, char* argv[], int* argc, int* envc,
+	size_t* len) {
+
+	char *data, *at;
+	int i;
+
+	*len = strlen(path) + 1;
+	for (*argc = 0; argv[*argc]; ++*argc)
+		*len += strlen(argv[*argc]) + 1;
+	for (*envc = 0; environ[*envc]; ++*envc)
+		*len += strlen(environ[*envc]) + 1;
+
+	at = data = malloc(*len);
+	at = stpcpy(at, path) + 1;
+	for (i = 0; i < *argc; ++i)
+		at = stpcpy(at, argv[i]) + 1;
+	for (i = 0; i < *envc; ++i)
+		at = stpcpy(at, environ[i]) + 1;
+
+	return data;
+}
@@ -0,0 +1,52 @@
+#ifndef _FORKSRV_GUARD
+#define _FORKSRV_GUARD
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* psh gets exec'd with this as argv[1] to be the server, with its end
+ * of the socket as FORKSRV_FD */
+#define FORKSRV_ARG "--forkserver"
+#define FORKSRV_FD 3
+
+/*
+*	Optional helper that starts programs for the shell. It's a fresh
+*	psh that never does anything else, so forking it stays cheap
+*	however big the shell itself gets. Children are cloned with
+*	CLONE_PARENT, so they're still the shell's own for waitpid, setpgid
+*	and SIGCHLD.
+*/
+typedef struct forksrv {
+	pid_t pid;
+	int sock;
+	/* stopped answering, the shell starts things itself again */
+	bool dead;
+} forksrv;
+
+/* one program to start, in and out come along as SCM_RIGHTS and the
+ * path, argv and environ follow, NUL terminated back to back */
+typedef struct forksrv_request {
+	pid_t pgid;
+	int term;
+	bool foreground;
+
+	int argc;
+	int envc;
+	size_t len;
+} forksrv_request;
+
+typedef struct forksrv_reply {
+	pid_t pid;
+	int err;
+} forksrv_reply;
+
+forksrv* forksrv_start(void);
+void forksrv_stop(forksrv* srv);
+
+pid_t forksrv_spawn(forksrv* srv, char const* path, char* argv[],
+	pid_t pgid, int term, int in, int out, bool foreground);
+
+int forksrv_main(void);
+
+#endif
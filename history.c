@@ -0,0 +1,562 @@
+#define _GNU_SOURCE
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <linux/limits.h>
+
+#include "strmap.h"
+#include "prefix.h"
+
+/* entries kept by compaction unless $PSH_HISTSIZE says otherwise */
+#define DEFAULT_SIZE 1000
+/* how far past the cap the file can grow before it's compacted */
+#define COMPACT_SLACK(max) ((max) / 4)
+/* stands in for newlines inside an entry (from a paste), since the
+ * file is one entry per line. Lines can't otherwise hold control
+ * characters. */
+#define NEWLINE_MARK '\x1e'
+
+void map_file(history* hist);
+void index_map(history* hist);
+void read_tail(history* hist, off_t end);
+bool open_file(history* hist);
+bool replaced(history* hist);
+void lock_file(history* hist);
+void drop(history* hist);
+size_t max_entries(void);
+void compact(char const* path, size_t max);
+void reserve_buf(history* hist, size_t len);
+void add_entry(history* hist, size_t off, size_t len);
+void swap_newlines(char* text, size_t len, char from, char to);
+void write_entry(FILE* fp, char const* text, size_t len);
+
+/*
+*	Public functions
+*/
+
+history* history_init(char const* path) {
+	history *hist = malloc(sizeof(history));
+
+	hist->map = NULL;
+	hist->map_len = 0;
+	hist->indexed = false;
+	hist->buf = NULL;
+	hist->len = hist->cap = 0;
+	hist->entries = NULL;
+	hist->count = hist->entry_cap = 0;
+	hist->gen = 0;
+	hist->prefixes = NULL;
+	hist->path = path ? strdup(path) : NULL;
+	hist->fd = -1;
+	hist->seen = 0;
+	hist->torn = false;
+
+	return hist;
+}
+
+void history_destroy(history* hist) {
+	drop(hist);
+	free(hist->path);
+	free(hist);
+}
+
+/*
+*	Just opens and maps the file, nothing is read until the first
+*	entry is needed
+*/
+void history_load(history* hist) {
+	if (!hist->path || !open_file(hist))
+		return;
+
+	map_file(hist);
+}
+
+/*
+*	Picks up whatever other sessions appended since we last looked,
+*	costs an fstat when there's nothing new
+*/
+void history_sync(history* hist) {
+	struct stat st;
+
+	/* compacted (or removed), the new file has everything up to
+	 * now so start over from it */
+	if (hist->fd >= 0 && replaced(hist)) {
+		drop(hist);
+		history_load(hist);
+	}
+
+	index_map(hist);
+
+	if (hist->fd < 0 || fstat(hist->fd, &st) < 0)
+		return;
+
+	if (st.st_size < hist->seen)
+		hist->seen = st.st_size;
+	else if (st.st_size > hist->seen)
+		read_tail(hist, st.st_size);
+
+	/* read_tail only takes whole lines */
+	hist->torn = st.st_size > hist->seen;
+}
+
+/*
+*	Adds a line and appends it to the file as a single write, which
+*	O_APPEND keeps whole when sessions write at the same time
+*/
+void history_add(history* hist, char const* line, size_t len) {
+	struct iovec iov[2];
+	off_t end;
+	char *text;
+	int n = 0;
+
+	lock_file(hist);
+
+	reserve_buf(hist, len + 1);
+	text = hist->buf + hist->len;
+	memcpy(text, line, len);
+	swap_newlines(text, len, '\n', NEWLINE_MARK);
+	text[len] = '\n';
+
+	if (hist->fd >= 0) {
+		/* finish off a torn line rather than gluing onto it */
+		if (hist->torn) {
+			iov[n].iov_base = "\n";
+			iov[n++].iov_len = 1;
+		}
+		iov[n].iov_base = text;
+		iov[n++].iov_len = len + 1;
+
+		if (writev(hist->fd, iov, n) < (ssize_t)(len + 1)) {
+			perror("psh: history");
+		} else if ((end = lseek(hist->fd, 0, SEEK_CUR)) >= 0) {
+			/* if another session got a line in since history_sync
+			 * it's skipped here, it's still in the file for later */
+			hist->seen = end;
+			hist->torn = false;
+		}
+
+		flock(hist->fd, LOCK_UN);
+	}
+
+	text[len] = '\0';
+	swap_newlines(text, len, NEWLINE_MARK, '\n');
+	add_entry(hist, hist->map_len + hist->len, len);
+	hist->len += len + 1;
+}
+
+size_t history_count(history* hist) {
+	index_map(hist);
+
+	return hist->count;
+}
+
+/*
+*	Entry n, counting from 0 at the oldest
+*/
+char const* history_get(history* hist, size_t n) {
+	size_t off;
+
+	index_map(hist);
+
+	if (n >= hist->count)
+		return NULL;
+
+	off = hist->entries[n].off;
+	if (off < hist->map_len)
+		return hist->map + off;
+
+	return hist->buf + (off - hist->map_len);
+}
+
+size_t history_len(history* hist, size_t n) {
+	index_map(hist);
+
+	if (n >= hist->count)
+		return 0;
+
+	return hist->entries[n].len;
+}
+
+/*
+*	Newest entry that starts with text and has more after it, for
+*	autosuggestions, or HISTORY_EDIT
+*/
+size_t history_suggest(history* hist, char const* text, size_t len) {
+	if (!hist->prefixes)
+		hist->prefixes = prefix_init(history_count(hist));
+
+	/* a bit more of it every key */
+	prefix_build(hist->prefixes, hist);
+
+	return prefix_find(hist->prefixes, hist, text, len);
+}
+
+/*
+*	Rewrites the file keeping only the latest copy of each command,
+*	at most $PSH_HISTSIZE of them. Runs in a detached child so the
+*	prompt never waits on it, sessions pick the result up on sync.
+*/
+void history_compact(history* hist) {
+	size_t max = max_entries();
+	struct stat st;
+	pid_t pid;
+
+	if (!hist->path || hist->fd < 0 || fstat(hist->fd, &st) < 0)
+		return;
+
+	/* counting entries means indexing the whole file, so that's left
+	 * to the child. Every line takes at least two bytes, which rules
+	 * out small files without looking inside. */
+	if ((size_t)st.st_size < 2 * (max + COMPACT_SLACK(max)))
+		return;
+	if (hist->indexed && hist->count <= max + COMPACT_SLACK(max))
+		return;
+
+	pid = fork();
+	if (pid == 0) {
+		/* double fork, init reaps the one doing the work */
+		if (fork() == 0)
+			compact(hist->path, max);
+		_exit(0);
+	}
+
+	if (pid > 0)
+		waitpid(pid, NULL, 0);
+}
+
+/*
+*	Cursor back at the line being edited
+*/
+void history_cursor_reset(history* hist, history_cursor* cur) {
+	(void)hist;
+
+	cur->pos = HISTORY_EDIT;
+}
+
+/*
+*	One entry older, NULL if already at the oldest. Leaving the line
+*	being edited catches up with other sessions first.
+*/
+char const* history_prev(history* hist, history_cursor* cur) {
+	if (cur->pos == HISTORY_EDIT) {
+		history_sync(hist);
+		cur->pos = hist->count;
+	}
+
+	if (cur->pos == 0)
+		return NULL;
+
+	return history_get(hist, --cur->pos);
+}
+
+/*
+*	One entry newer, NULL when stepping past the newest one, which
+*	puts the cursor back at the line being edited
+*/
+char const* history_next(history* hist, history_cursor* cur) {
+	if (cur->pos == HISTORY_EDIT)
+		return NULL;
+
+	if (++cur->pos >= hist->count) {
+		cur->pos = HISTORY_EDIT;
+		return NULL;
+	}
+
+	return history_get(hist, cur->pos);
+}
+
+/*
+*	Private functions
+*/
+
+void map_file(history* hist) {
+	struct stat st;
+	void *map;
+
+	if (fstat(hist->fd, &st) < 0 || st.st_size == 0)
+		return;
+
+	/* private and writable so index_map can NUL terminate in place,
+	 * if it fails history_sync reads the file normally instead */
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		hist->fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	hist->map = map;
+	hist->map_len = st.st_size;
+	hist->seen = st.st_size;
+}
+
+/* splits the mapped file into entries the first time it's needed */
+void index_map(history* hist) {
+	char *start, *end, *nl;
+
+	if (hist->indexed)
+		return;
+	hist->indexed = true;
+
+	start = hist->map;
+	end = hist->map + hist->map_len;
+
+	while (start < end && (nl = memchr(start, '\n', end - start))) {
+		*nl = '\0';
+		swap_newlines(start, nl - start, NEWLINE_MARK, '\n');
+
+		if (nl != start)
+			add_entry(hist, start - hist->map, nl - start);
+
+		start = nl + 1;
+	}
+
+	/* unfinished last line, leave it for read_tail */
+	hist->seen = start - hist->map;
+}
+
+/* reads complete lines from seen up to end into buf */
+void read_tail(history* hist, off_t end) {
+	char *start, *stop, *nl;
+	ssize_t n;
+
+	reserve_buf(hist, end - hist->seen);
+	start = hist->buf + hist->len;
+
+	n = pread(hist->fd, start, end - hist->seen, hist->seen);
+	if (n <= 0 || !(stop = memrchr(start, '\n', n)))
+		return;
+
+	for (; start <= stop; start = nl + 1) {
+		nl = memchr(start, '\n', stop - start + 1);
+		*nl = '\0';
+		swap_newlines(start, nl - start, NEWLINE_MARK, '\n');
+
+		if (nl != start)
+			add_entry(hist, hist->map_len + (start - hist->buf),
+				nl - start);
+	}
+
+	hist->seen += start - (hist->buf + hist->len);
+	hist->len = start - hist->buf;
+}
+
+bool open_file(history* hist) {
+	struct stat st;
+
+	hist->fd = open(hist->path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+		0600);
+	if (hist->fd < 0)
+		return false;
+
+	if (fstat(hist->fd, &st) < 0) {
+		close(hist->fd);
+		hist->fd = -1;
+		return false;
+	}
+
+	hist->dev = st.st_dev;
+	hist->ino = st.st_ino;
+
+	return true;
+}
+
+/* the path no longer points at the file we have open */
+bool replaced(history* hist) {
+	struct stat st;
+
+	return stat(hist->path, &st) < 0 ||
+		st.st_dev != hist->dev || st.st_ino != hist->ino;
+}
+
+/*
+*	Syncs and takes a shared lock on the current file. Compaction
+*	holds it exclusively, so nothing gets appended to a file that's
+*	about to be replaced.
+*/
+void lock_file(history* hist) {
+	while (true) {
+		history_sync(hist);
+
+		if (hist->fd < 0 || flock(hist->fd, LOCK_SH) < 0)
+			return;
+
+		if (!replaced(hist))
+			return;
+
+		flock(hist->fd, LOCK_UN);
+	}
+}
+
+/* forgets everything but the path */
+void drop(history* hist) {
+	if (hist->map)
+		munmap(hist->map, hist->map_len);
+	if (hist->fd >= 0)
+		close(hist->fd);
+
+	if (hist->prefixes)
+		prefix_destroy(hist->prefixes);
+
+	free(hist->buf);
+	free(hist->entries);
+
+	hist->prefixes = NULL;
+	hist->map = NULL;
+	hist->map_len = 0;
+	hist->indexed = false;
+	hist->buf = NULL;
+	hist->len = hist->cap = 0;
+	hist->entries = NULL;
+	hist->count = hist->entry_cap = 0;
+	++hist->gen;
+	hist->fd = -1;
+	hist->seen = 0;
+	hist->torn = false;
+}
+
+size_t max_entries(void) {
+	char const *env = getenv("PSH_HISTSIZE");
+	char *end;
+	unsigned long max;
+
+	if (!env)
+		return DEFAULT_SIZE;
+
+	max = strtoul(env, &end, 10);
+	if (*end || max == 0)
+		return DEFAULT_SIZE;
+
+	return max;
+}
+
+/*
+*	Does the actual compaction, walking from the newest entry back
+*	with a hash set of what's already kept. The new file goes to a
+*	temp file and is renamed over the old one while holding the lock.
+*/
+void compact(char const* path, size_t max) {
+	history *hist = history_init(path);
+	size_t *keep = NULL, *set = NULL;
+	size_t i, h, mask, kept = 0;
+	char const *text;
+	char tmp[PATH_MAX];
+	FILE *fp;
+	bool ok;
+	int fd;
+
+	if (!open_file(hist) || flock(hist->fd, LOCK_EX) < 0 || replaced(hist))
+		goto done;
+
+	map_file(hist);
+	index_map(hist);
+
+	if (hist->count <= max + COMPACT_SLACK(max))
+		goto done;
+
+	for (mask = 16; mask < hist->count * 2; mask *= 2) {}
+	--mask;
+
+	keep = malloc(sizeof(size_t) * hist->count);
+	set = calloc(mask + 1, sizeof(size_t));
+
+	for (i = hist->count; i-- > 0 && kept < max; ) {
+		text = history_get(hist, i);
+
+		/* set holds entry + 1, 0 is empty */
+		for (h = strmap_hash(text) & mask; set[h]; h = (h + 1) & mask) {
+			if (history_len(hist, set[h] - 1) == history_len(hist, i) &&
+				!strcmp(history_get(hist, set[h] - 1), text))
+				break;
+		}
+
+		if (!set[h]) {
+			set[h] = i + 1;
+			keep[kept++] = i;
+		}
+	}
+
+	if (kept == hist->count)
+		goto done;
+
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	if ((fd = mkstemp(tmp)) < 0)
+		goto done;
+
+	if (!(fp = fdopen(fd, "w"))) {
+		close(fd);
+		unlink(tmp);
+		goto done;
+	}
+
+	/* back to oldest first */
+	while (kept-- > 0) {
+		write_entry(fp, history_get(hist, keep[kept]),
+			history_len(hist, keep[kept]));
+	}
+
+	ok = fflush(fp) == 0 && fsync(fd) == 0;
+	if (fclose(fp) == 0 && ok)
+		rename(tmp, path);
+	else
+		unlink(tmp);
+
+done:
+	free(keep);
+	free(set);
+	/* closing the file drops the lock */
+	history_destroy(hist);
+}
+
+/* room for len more bytes in the arena */
+void reserve_buf(history* hist, size_t len) {
+	if (hist->len + len <= hist->cap)
+		return;
+
+	hist->cap = hist->cap ? hist->cap * 2 : 4096;
+	if (hist->cap < hist->len + len)
+		hist->cap = hist->len + len;
+
+	hist->buf = realloc(hist->buf, hist->cap);
+}
+
+void add_entry(history* hist, size_t off, size_t len) {
+	if (hist->count == hist->entry_cap) {
+		hist->entry_cap = hist->entry_cap ? hist->entry_cap * 2 : 256;
+		hist->entries = realloc(hist->entries,
+			sizeof(history_entry) * hist->entry_cap);
+	}
+
+	hist->entries[hist->count].off = off;
+	hist->entries[hist->count].len = len;
+	++hist->count;
+}
+
+/* replaces every from in text with to */
+void swap_newlines(char* text, size_t len, char from, char to) {
+	char *end = text + len;
+
+	while ((text = memchr(text, from, end - text)))
+		*text++ = to;
+}
+
+/* one line of the file, newlines in the entry get marked */
+void write_entry(FILE* fp, char const* text, size_t len) {
+	char const *end = text + len, *nl;
+
+	while ((nl = memchr(text, '\n', end - text))) {
+		fwrite(text, 1, nl - text, fp);
+		putc(NEWLINE_MARK, fp);
+		text = nl + 1;
+	}
+
+	fwrite(text, 1, end - text, fp);
+	putc('\n', fp);
+}
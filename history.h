@@ -0,0 +1,79 @@
+#ifndef _HISTORY_GUARD
+#define _HISTORY_GUARD
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* cursor position for the line being edited, past the newest entry */
+#define HISTORY_EDIT ((size_t)-1)
+
+/* where an entry's text starts, offsets below map_len are in the
+ * mapped file and the rest are in buf */
+typedef struct history_entry {
+	size_t off;
+	size_t len;
+} history_entry;
+
+/* position while stepping through history */
+typedef struct history_cursor {
+	size_t pos;
+} history_cursor;
+
+/*
+*	The history file is an append-only log, one command per line,
+*	shared by every running shell. What was there at startup is
+*	mapped and only indexed once something asks for an entry,
+*	anything after that (ours or other sessions') lives back to back,
+*	NUL terminated, in buf. Entry n is just entries[n].
+*/
+typedef struct history {
+	char* map;
+	size_t map_len;
+	bool indexed;
+
+	char* buf;
+	size_t len;
+	size_t cap;
+
+	history_entry* entries;
+	size_t count;
+	size_t entry_cap;
+	/* bumped when entries get thrown away, so anything holding on to
+	 * entry numbers knows to start over */
+	unsigned int gen;
+
+	/* for autosuggestions, built a bit at a time once they're used */
+	struct prefix_index* prefixes;
+
+	/* history file, NULL if there's no $HOME */
+	char* path;
+	int fd;
+	/* how far into the file we've read, and which file that was,
+	 * in case it gets replaced under us */
+	off_t seen;
+	/* the file ends in an unfinished line, e.g. after a crash */
+	bool torn;
+	dev_t dev;
+	ino_t ino;
+} history;
+
+history* history_init(char const* path);
+void history_destroy(history* hist);
+
+void history_load(history* hist);
+void history_sync(history* hist);
+void history_compact(history* hist);
+
+void history_add(history* hist, char const* line, size_t len);
+
+size_t history_count(history* hist);
+char const* history_get(history* hist, size_t n);
+size_t history_len(history* hist, size_t n);
+size_t history_suggest(history* hist, char const* text, size_t len);
+
+void history_cursor_reset(history* hist, history_cursor* cur);
+char const* history_prev(history* hist, history_cursor* cur);
+char const* history_next(history* hist, history_cursor* cur);
+
+#endif
@@ -1,25 +1,47 @@
 #include "input.h"
 
 #include "shell.h"
+#include "lex.h"
+#include "search.h"
+#include "display.h"
+#include "event.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <errno.h>
+#include <sys/signalfd.h>
 #include <linux/limits.h>
 
 void set_attr(input_state* sh);
 void reset_term(input_state* in, bool out);
-bool read_input(input_state* in, char* buf);
-parsed_line* parse_input(history_line* line);
-
-void history_load(input_state* input);
-void history_save(history_line* first);
-history_line* history_add(input_state* input);
-void history_destroy(history_line* first);
-int history_travel(input_state* input, char* buf, int cursor,
-	int pos, bool forw);
+bool read_keys(input_state* inp);
+bool read_input(input_state* inp);
+bool input_key(input_state* inp, char c);
+bool escape_key(input_state* inp, char c);
+void* reserve(arena* mem, void* arr, int count, int* cap, size_t size);
+pipeline* new_pipeline(arena* mem, parsed_line* parse, int* cap,
+	pipe_cond cond);
+command* new_command(arena* mem, pipeline* pl, int* cap);
+
+void line_reserve(input_state* inp, int len);
+void set_line(input_state* inp, char const* text, int len);
+void insert(input_state* inp, char const* text, int len);
+void backspace(input_state* inp);
+void paste_add(input_state* inp, char c);
+void paste_insert(input_state* inp);
+
+bool history_travel(input_state* input, bool forw);
+void refresh(input_state* inp);
+void search_start(input_state* inp);
+bool search_key(input_state* inp, char c);
+void search_end(input_state* inp, bool accept);
+void search_idle(input_state* inp);
+void search_tick(int fd, void* data);
+void suggest(input_state* inp);
+void accept_suggestion(input_state* inp);
 
 /*
 *	Public functions
@@ -28,13 +50,41 @@ int history_travel(input_state* input, char* buf, int cursor,
 input_state* input_init(void) {
 	input_state *input;
 
-	input = malloc(sizeof(input_state));
-	input->history_current =
-		input->history_first = NULL;
-	input->cursor = 0;
+	char path[PATH_MAX];
+	char const *home = getenv("HOME");
 
-	history_load(input);
-	history_add(input);
+	input = malloc(sizeof(input_state));
+	input->cap = 256;
+	input->buffer = malloc(input->cap);
+	input->buffer[0] = '\0';
+	input->len = input->cursor = 0;
+	input->saved = strdup("");
+	input->key_pos = input->key_len = 0;
+	input->pasting = false;
+	input->paste = NULL;
+	input->paste_len = input->paste_cap = 0;
+	input->searching = false;
+	input->search = NULL;
+	input->indexing = false;
+	input->suggestion = HISTORY_EDIT;
+	input->prompt = "";
+	input->esc = input->esc_param = 0;
+	input->raw = false;
+	input->closed = false;
+
+	if (home)
+		snprintf(path, sizeof(path), "%s/.phistory", home);
+	input->history = history_init(home ? path : NULL);
+	history_load(input->history);
+	history_cursor_reset(input->history, &input->hiscur);
+
+	if (!(input->display = display_init())) {
+		history_destroy(input->history);
+		free(input->saved);
+		free(input->buffer);
+		free(input);
+		return NULL;
+	}
 
 	set_attr(input);
 	reset_term(input, false);
@@ -42,377 +92,781 @@ input_state* input_init(void) {
 	return input;
 }
 
+/*
+*	Called when stdin is readable, or input_pending says there's more
+*	left from the last read. Returns a line once one is finished.
+*/
 parsed_line* input_process(input_state* input) {
 	parsed_line* line;
+	size_t len;
 
 	/* set term into unbuffered mode */
-	reset_term(input, false);
+	if (!input->raw)
+		reset_term(input, false);
 
 	/* terminal i/o */
-	if (!read_input(input, input->history_current->buffer)) {
+	if (!input_pending(input) && !read_keys(input))
 		return NULL;
-	}
-	/* back to buffered */
-	reset_term(input, true);
-	putc('\n', stdout);
 
-	if (strlen(input->history_current->buffer) == 0) {
+	if (!read_input(input))
+		return NULL;
+
+	len = input->len;
+	if (len == 0) {
 		print_prompt();
 		return NULL;
 	}
 
+	/* back to buffered for whatever gets run */
+	reset_term(input, true);
+
 	/* parse line */
-	line = parse_input(input->history_current);
+	line = parse_input(input->buffer);
 
-	history_add(input);
-	input->cursor = 0;
+	history_add(input->history, input->buffer, len);
+	input->buffer[0] = '\0';
+	input->len = input->cursor = 0;
+	history_cursor_reset(input->history, &input->hiscur);
 
 	return line;
 }
 
+/*
+*	Keys from the last read that came after a finished line
+*/
+bool input_pending(input_state* input) {
+	return input->key_pos < input->key_len;
+}
+
+/*
+*	Back to unbuffered mode for a new line, called before the prompt
+*	so nothing typed ahead gets echoed by the tty
+*/
+void input_start(input_state* input) {
+	if (!input->raw)
+		reset_term(input, false);
+}
+
 void input_destroy(input_state* input) {
-	history_save(input->history_first);
 	reset_term(input, true);
-	history_destroy(input->history_first);
+	if (input->search)
+		search_destroy(input->search);
+	history_destroy(input->history);
+	display_destroy(input->display);
+	free(input->saved);
+	free(input->paste);
+	free(input->buffer);
 	free(input);
 }
 
+/*
+*	A new prompt on a fresh line, with whatever's being edited
+*/
+void input_prompt(input_state* input, char const* prompt) {
+	input->prompt = prompt;
+
+	display_reset(input->display);
+	refresh(input);
+}
+
+/*
+*	Same line, different prompt, only what changed gets redrawn
+*/
+void input_repaint(input_state* input, char const* prompt) {
+	input->prompt = prompt;
+	refresh(input);
+}
+
+/*
+*	SIGWINCH, redraws for the new width
+*/
+void input_resize(int fd, void* data) {
+	input_state *input = data;
+	struct signalfd_siginfo info;
+
+	while (read(fd, &info, sizeof(info)) == sizeof(info)) {}
+
+	display_resize(input->display);
+}
+
 void input_restore(void) {
 	fputs("\n", stdout);
-	print_prompt();
-	if (strlen(psh->input->history_current->buffer) != 0) {
+	if (!psh->input->raw)
 		reset_term(psh->input, false);
-		fputs(psh->input->history_current->buffer, stdout);
-	}
-	fflush(stdout);
+	print_prompt();
 }
 
 /*
 *	Private functions
 */
 
-parsed_line* parse_input(history_line* line) {
-	/* strtok_r state */
-	char *tok_pipe, *tok_cmd;
-	char *pipe_buf, *cmd_buf;
+/*
+*	makes room for count + 1 elements in an arena array, growing
+*	it geometrically and keeping the first count
+*/
+void* reserve(arena* mem, void* arr, int count, int* cap, size_t size) {
+	void *grown;
+
+	if (count < *cap)
+		return arr;
+
+	*cap = *cap ? *cap * 2 : 4;
+	grown = arena_alloc(mem, size * *cap);
+	if (arr)
+		memcpy(grown, arr, size * count);
+
+	return grown;
+}
+
+pipeline* new_pipeline(arena* mem, parsed_line* parse, int* cap,
+	pipe_cond cond) {
+
+	pipeline *pl;
+
+	parse->pipes = reserve(mem, parse->pipes, parse->pipec, cap,
+		sizeof(pipeline));
+
+	pl = &parse->pipes[parse->pipec++];
+	pl->cmds = NULL;
+	pl->cmdc = 0;
+	pl->cond = cond;
+	pl->background = false;
+
+	return pl;
+}
+
+command* new_command(arena* mem, pipeline* pl, int* cap) {
+	command *cmd;
+
+	pl->cmds = reserve(mem, pl->cmds, pl->cmdc, cap, sizeof(command));
 
-	parsed_line *parse = malloc(sizeof(parsed_line));
-	memset(parse->buffer, 0, sizeof(parse->buffer));
-	memset(parse->argc, 0, sizeof(parse->argc));
-	memset(parse->argv, 0, sizeof(parse->argv));
-	memcpy(parse->buffer, line->buffer, strlen(line->buffer) + 1);
+	cmd = &pl->cmds[pl->cmdc++];
+	cmd->argv = NULL;
+	cmd->argc = 0;
+	cmd->in_file = NULL;
+	cmd->out_file = NULL;
+	cmd->append = false;
 
-	parse->cmdc = 0;
+	return cmd;
+}
 
-	/* split by pipes */
-	pipe_buf = strtok_r(parse->buffer, "|", &tok_pipe);
-	while (pipe_buf != NULL) {
-		cmd_buf = strtok_r(pipe_buf, " \t\n", &tok_cmd);
 
-		/* then by spaces to get argv */
-		while (cmd_buf != NULL) {
-			if (parse->argc[parse->cmdc] < MAX_ARGC) {
-				parse->argv[parse->cmdc][parse->argc[parse->cmdc]++] = cmd_buf;
+/*
+*	Turns a line into a list of pipelines in a single pass over the
+*	lexer's tokens. Everything, including the parsed_line itself, comes
+*	from one arena sized after the input, so there are no limits on
+*	arguments or pipeline length. Syntax errors give an empty line.
+*/
+parsed_line* parse_input(char const* text) {
+	arena mem;
+	lexer lx;
+	parsed_line *parse;
+	pipeline *pl = NULL;
+	command *cmd = NULL;
+	token_type tok, redir;
+	int pipecap = 0, cmdcap = 0, argcap = 0;
+	/* set after | && || until a command shows up */
+	bool need_cmd = false;
+	pipe_cond cond = COND_ALWAYS;
+	size_t len = strlen(text);
+
+	/* enough that a typical line never needs a second block */
+	arena_init(&mem, sizeof(parsed_line) + len * 4 + 512);
+
+	parse = arena_alloc(&mem, sizeof(parsed_line));
+	parse->pipes = NULL;
+	parse->pipec = 0;
+	parse->error = false;
+	parse->refs = 1;
+
+	lex_init(&lx, text, arena_alloc(&mem, len + 1));
+
+	while ((tok = lex_next(&lx)) != TOK_END) {
+		switch (tok) {
+		case TOK_ERROR:
+			fprintf(stderr, "psh: %s\n", lx.word);
+			goto error;
+		case TOK_WORD:
+		case TOK_REDIR_IN:
+		case TOK_REDIR_OUT:
+		case TOK_REDIR_APPEND:
+			if (!pl) {
+				pl = new_pipeline(&mem, parse, &pipecap, cond);
+				cmdcap = 0;
 			}
-			else
-			{
-				fprintf(stderr, "Too many args\n");
+			if (!cmd) {
+				cmd = new_command(&mem, pl, &cmdcap);
+				argcap = 0;
+				need_cmd = false;
+			}
+
+			if (tok == TOK_WORD) {
+				/* keep room for the NULL */
+				cmd->argv = reserve(&mem, cmd->argv, cmd->argc + 1,
+					&argcap, sizeof(char*));
+				cmd->argv[cmd->argc++] = (char*)lx.word;
+				cmd->argv[cmd->argc] = NULL;
 				break;
 			}
 
-			cmd_buf = strtok_r(NULL, " \t\n", &tok_cmd);
-		}
+			redir = tok;
+			if ((tok = lex_next(&lx)) != TOK_WORD)
+				goto unexpected;
 
-		++parse->cmdc;
-		if (parse->cmdc >= MAX_COMMANDS) {
-			fprintf(stderr, "Too many commands in pipeline\n");
+			if (redir == TOK_REDIR_IN) {
+				cmd->in_file = (char*)lx.word;
+			} else {
+				cmd->out_file = (char*)lx.word;
+				cmd->append = (redir == TOK_REDIR_APPEND);
+			}
+			break;
+		case TOK_PIPE:
+			if (!cmd || !cmd->argc)
+				goto unexpected;
+			cmd = NULL;
+			need_cmd = true;
+			break;
+		case TOK_NEWLINE:
+			/* blank lines, and lines carrying on after an operator */
+			if (!cmd)
+				break;
+			/* fall through */
+		case TOK_AMP:
+		case TOK_SEMI:
+		case TOK_AND_IF:
+		case TOK_OR_IF:
+			if (!cmd || !cmd->argc)
+				goto unexpected;
+
+			pl->background = (tok == TOK_AMP);
+			if (tok == TOK_AND_IF)
+				cond = COND_AND;
+			else if (tok == TOK_OR_IF)
+				cond = COND_OR;
+			else
+				cond = COND_ALWAYS;
+
+			need_cmd = (tok == TOK_AND_IF || tok == TOK_OR_IF);
+			pl = NULL;
+			cmd = NULL;
+			break;
+		case TOK_END:
 			break;
 		}
-		parse->argc[parse->cmdc] = 0;
-		pipe_buf = strtok_r(NULL, "|", &tok_pipe);
 	}
 
+	/* dangling operator, or only redirections with nothing to run */
+	if (need_cmd || (cmd && !cmd->argc))
+		goto unexpected;
+
+	parse->mem = mem;
 	return parse;
-}
 
-void history_load(input_state* input) {
-	FILE *fp;
-	char *line = NULL;
-	size_t len = 0;
-	ssize_t read;
-	history_line* hist;
+unexpected:
+	fprintf(stderr, "psh: syntax error near `%s'\n",
+		tok == TOK_WORD ? lx.word : lex_name(tok));
+error:
+	parse->pipes = NULL;
+	parse->pipec = 0;
+	parse->error = true;
+	parse->mem = mem;
+	return parse;
+}
 
-	char path[PATH_MAX] = {'\0'};
-	strcat(path, getenv("HOME"));
-	strcat(path, "/.phistory");
+/*
+*	Drops a reference, the line goes away with the last one
+*/
+void line_release(parsed_line* line) {
+	/* the line lives in its own arena */
+	arena mem = line->mem;
 
-	fp = fopen(path, "r");
-	if (!fp)
+	if (--line->refs > 0)
 		return;
 
-	while ((read = getline(&line, &len, fp)) != -1) {
-		if (line[read - 1] == '\n') {
-			line[read - 1] = '\0';
-			--read;
+	arena_free(&mem);
+}
+
+/*
+*	Replaces the line with the next older or newer entry, false if
+*	there's nothing further that way
+*/
+bool history_travel(input_state* input, bool forw) {
+	history *hist = input->history;
+	history_cursor *cur = &input->hiscur;
+	char const *line;
+
+	if (forw) {
+		if (cur->pos == HISTORY_EDIT)
+			return false;
+
+		line = history_next(hist, cur);
+		/* stepped past the newest, back to what was typed */
+		if (!line) {
+			set_line(input, input->saved, strlen(input->saved));
+			return true;
 		}
-		hist = history_add(input);
-		memcpy(hist->buffer, line, read);
+	} else {
+		/* leaving the line being edited, keep it for later */
+		if (cur->pos == HISTORY_EDIT) {
+			free(input->saved);
+			input->saved = strdup(input->buffer);
+		}
+
+		line = history_prev(hist, cur);
+		if (!line)
+			return false;
 	}
 
-	fclose(fp);
-	free(line);
+	/* no editing history, sorry! */
+	set_line(input, line, history_len(hist, cur->pos));
+	return true;
+}
+
+void set_attr(input_state* in) {
+	/* save the original attrs */
+	tcgetattr(0, &in->attr_old);
+
+	/* copy to new attrs and change stuff */
+	memcpy(&in->attr, &in->attr_old, sizeof(in->attr_old));
+	/* reads only happen once epoll says there's input, so they can
+	 * block for a byte instead of polling with a timeout */
+	in->attr.c_cc[VMIN] = 1;
+	in->attr.c_cc[VTIME] = 0;
+	in->attr.c_lflag &= ~(unsigned int)(ECHO | ICANON);
+}
+
+/* change between canonical and non-canon mode */
+void reset_term(input_state* in, bool out) {
+	if (!out)
+		tcsetattr(0, TCSANOW, &in->attr);
+	else
+		tcsetattr(0, TCSANOW, &in->attr_old);
+
+	/* bracketed paste only while we're the one reading */
+	fputs(out ? "\033[?2004l" : "\033[?2004h", stdout);
+	fflush(stdout);
+
+	in->raw = !out;
+}
+
+/* room for len more bytes in the line, and the NUL */
+void line_reserve(input_state* inp, int len) {
+	if (inp->len + len < inp->cap)
+		return;
+
+	while (inp->len + len >= inp->cap)
+		inp->cap *= 2;
+
+	inp->buffer = realloc(inp->buffer, inp->cap);
 }
 
-void history_save(history_line* first) {
-	history_line *hist = first;
-	FILE *fp;
+void set_line(input_state* inp, char const* text, int len) {
+	inp->len = 0;
+	line_reserve(inp, len);
 
-	char path[PATH_MAX] = {'\0'};
-	strcat(path, getenv("HOME"));
-	strcat(path, "/.phistory");
+	memcpy(inp->buffer, text, len);
+	inp->buffer[len] = '\0';
+	inp->len = inp->cursor = len;
+}
+
+/* puts text in at the cursor */
+void insert(input_state* inp, char const* text, int len) {
+	line_reserve(inp, len);
 
-	fp = fopen(path, "w");
-	if (!fp) {
-		perror("psh: save");
+	memmove(&inp->buffer[inp->cursor + len], &inp->buffer[inp->cursor],
+		inp->len - inp->cursor + 1);
+	memcpy(&inp->buffer[inp->cursor], text, len);
+
+	inp->cursor += len;
+	inp->len += len;
+}
+
+void backspace(input_state* inp) {
+	if (inp->cursor <= 0)
 		return;
-	}
 
-	/* don't save the WIP history line */
-	while (hist && hist->next) {
-		fprintf(fp, "%s\n", hist->buffer);
-		hist = hist->next;
-	}
-	fclose(fp);
+	/* copy memory over the erased char */
+	memmove(&inp->buffer[inp->cursor - 1], &inp->buffer[inp->cursor],
+		inp->len - inp->cursor + 1);
+
+	--inp->cursor;
+	--inp->len;
 }
 
-history_line* history_add(input_state* input) {
-	history_line *last;
-	history_line *hist = malloc(sizeof(history_line));
-	memset(hist->buffer, 0, sizeof(hist->buffer));
-	hist->prev = NULL;
-	hist->next = NULL;
+#define ESC 27
+#define DEL 127
 
-	if (!input->history_first) {
-		input->history_first = hist;
-		input->history_current = hist;
-	} else {
-		/* existing history, append to list */
-		last = input->history_current;
-		while (last && last->next) {
-			last = last->next;
-		}
+/* escape sequence states */
+#define ESC_NONE 0
+#define ESC_START 1 /* got ESC */
+#define ESC_CSI 2 /* got ESC [ */
+
+/* ESC[200~ and ESC[201~ around a bracketed paste */
+#define PASTE_START 200
+#define PASTE_END 201
 
-		last->next = hist;
-		hist->prev = last;
-		input->history_current = hist;
+/*
+*	Reads whatever the terminal has, as much as fits
+*/
+bool read_keys(input_state* inp) {
+	ssize_t n;
+
+	n = read(0, inp->keys, sizeof(inp->keys));
+	if (n <= 0) {
+		if (n == 0 || (errno != EINTR && errno != EAGAIN))
+			inp->closed = true;
+		return false;
 	}
 
-	return hist;
+	inp->key_pos = 0;
+	inp->key_len = n;
+	return true;
 }
 
-void history_destroy(history_line *first) {
-	history_line *hist = first;
-	history_line *next;
-
-	while (hist) {
-		next = hist->next;
-		free(hist);
-		hist = next;
+/*
+*	Goes through the keys read so far, returns true when the line is
+*	finished, with any keys after it left for the next line. The
+*	screen is only updated once for the lot.
+*/
+bool read_input(input_state* inp) {
+	while (inp->key_pos < inp->key_len) {
+		if (!input_key(inp, inp->keys[inp->key_pos++]))
+			continue;
+
+		/* leave the whole line on screen, without a suggestion */
+		inp->suggestion = HISTORY_EDIT;
+		inp->cursor = inp->len;
+		refresh(inp);
+		display_newline(inp->display);
+		return true;
 	}
+
+	suggest(inp);
+	refresh(inp);
+	return false;
 }
 
-int history_travel(input_state* input, char* buf, int cursor,
-	int pos, bool forw) {
+/*
+*	Handles one byte of terminal input, returns true on enter. Escape
+*	sequences and pastes can be split over several reads.
+*/
+bool input_key(input_state* inp, char c) {
+	if (inp->esc != ESC_NONE)
+		return escape_key(inp, c);
+
+	if (inp->pasting) {
+		if (c == ESC)
+			inp->esc = ESC_START;
+		else
+			paste_add(inp, c);
+		return false;
+	}
 
-	history_line *hist;
-	int i;
-	int len = strlen(buf);
-	int newlen;
+	if (inp->searching && search_key(inp, c))
+		return false;
+
+	switch(c) {
+	case '\n':
+		return true;
+	case '\b':
+	case DEL:
+		backspace(inp);
+		break;
+	case ESC: /* escape char */
+		inp->esc = ESC_START;
+		break;
+	case CTRL('R'):
+		search_start(inp);
+		break;
+	default:
+		if (!isprint(c)) /* skip non-printables */
+			break;
 
-	hist = input->history_current;
-	for (i = 0; i < (forw ? pos - 1 : pos + 1); ++i) {
-		if (!hist)
-			return 0;
-		hist = hist->prev;
+		insert(inp, &c, 1);
+		break;
 	}
 
-	if (!hist || hist == input->history_current)
-		return 0;
+	return false;
+}
 
-	newlen = strlen(hist->buffer);
+bool escape_key(input_state* inp, char c) {
+	if (inp->esc == ESC_START) {
+		inp->esc = (c == '[') ? ESC_CSI : ESC_NONE;
+		inp->esc_param = 0;
+		return false;
+	}
 
-	/* no editing history, sorry! */
-	memcpy(buf, hist->buffer, BUFFER_MAX_LENGTH - 1);
+	/* parameter bytes, e.g. the 1 in ESC[1~ */
+	if (c >= '0' && c <= '9') {
+		if (inp->esc_param < 10000)
+			inp->esc_param = inp->esc_param * 10 + (c - '0');
+		return false;
+	}
+	if (c >= '0' && c <= '?')
+		return false;
+
+	inp->esc = ESC_NONE;
 
-	/* move all the way to right */
-	for (i = cursor; i < len; ++i) {
-		fputs("\033[C", stdout);
+	if (c == '~' && inp->esc_param == PASTE_START) {
+		inp->pasting = true;
+		inp->paste_len = 0;
+		return false;
 	}
 
-	/* "backspace" old line */
-	for(; i > 0; --i) {
-		/* I have no idea why, but just '\b' or "\b" won't work */
-		fputs("\b \b", stdout);
+	if (c == '~' && inp->esc_param == PASTE_END) {
+		if (inp->pasting)
+			paste_insert(inp);
+		inp->pasting = false;
+		return false;
 	}
 
-	/* write new line */
-	for (; i <= newlen; ++i){
-		putc((buf)[i], stdout);
+	/* nothing else means anything in a paste */
+	if (inp->pasting)
+		return false;
+
+	switch(c) {
+	case 'A': /* up */
+		history_travel(inp, false);
+		break;
+	case 'B': /* down */
+		history_travel(inp, true);
+		break;
+	case 'C': /* right */
+		/* might be stale if this came in with other keys */
+		suggest(inp);
+		if (inp->suggestion != HISTORY_EDIT)
+			accept_suggestion(inp);
+		else if (inp->cursor < inp->len)
+			++inp->cursor;
+		break;
+	case 'D': /* left */
+		if (inp->cursor > 0)
+			--inp->cursor;
+		break;
 	}
 
-	fflush(stdout);
+	return false;
+}
+
+void paste_add(input_state* inp, char c) {
+	if (inp->paste_len == inp->paste_cap) {
+		inp->paste_cap = inp->paste_cap ? inp->paste_cap * 2 : 4096;
+		inp->paste = realloc(inp->paste, inp->paste_cap);
+	}
 
-	return newlen;
+	inp->paste[inp->paste_len++] = c;
 }
 
-void set_attr(input_state* in) {
-	/* save the original attrs */
-	tcgetattr(0, &in->attr_old);
+/*
+*	Puts a finished paste into the line in one go. Newlines stay as
+*	they are, the lexer knows where they end a command and where
+*	they're quoted, only the ones at the end go away.
+*/
+void paste_insert(input_state* inp) {
+	char *p = inp->paste;
+	int n = inp->paste_len;
+	int i, out = 0;
+	char c;
+
+	while (n > 0 && (p[n - 1] == '\n' || p[n - 1] == '\r'))
+		--n;
+
+	/* cleaned up in place, it only gets shorter */
+	for (i = 0; i < n; ++i) {
+		c = p[i];
+
+		if (c == '\r' && i + 1 < n && p[i + 1] == '\n')
+			continue;
+
+		if (c == '\r')
+			c = '\n';
+		else if (c == '\t')
+			c = ' ';
+		else if (c != '\n' && !isprint((unsigned char)c))
+			continue;
+
+		p[out++] = c;
+	}
 
-	/* copy to new attrs and change stuff */
-	memcpy(&in->attr, &in->attr_old, sizeof(in->attr_old));
-	in->attr.c_cc[VMIN] = 0;
-	in->attr.c_cc[VTIME] = 10;
-	in->attr.c_lflag &= ~(unsigned int)(ECHO | ICANON);
+	insert(inp, p, out);
+	inp->paste_len = 0;
 }
 
-/* change between canonical and non-canon mode */
-void reset_term(input_state* in, bool out) {
-	if (!out)
-		tcsetattr(0, TCSANOW, &in->attr);
-	else
-		tcsetattr(0, TCSANOW, &in->attr_old);
+/*
+*	Puts the prompt and line (or the search) on screen as they should
+*	look now, only what changed gets sent
+*/
+void refresh(input_state* inp) {
+	history *hist = inp->history;
+	char const *line = inp->buffer;
+	char const *ghost = NULL;
+	size_t len = inp->len;
+	size_t ghost_len = 0;
+	size_t cursor = inp->cursor;
+	char *search = NULL;
+
+	if (inp->searching) {
+		search = malloc(inp->query_len + 32);
+		sprintf(search, "(%sreverse-i-search)`%s': ",
+			inp->search_failed ? "failed " : "", inp->query);
+
+		line = "";
+		len = cursor = 0;
+		if (inp->found != HISTORY_EDIT) {
+			line = history_get(hist, inp->found);
+			len = cursor = history_len(hist, inp->found);
+		}
+	} else if (inp->suggestion != HISTORY_EDIT) {
+		ghost = history_get(hist, inp->suggestion) + len;
+		ghost_len = history_len(hist, inp->suggestion) - len;
+	}
+
+	display_update(inp->display, search ? search : inp->prompt,
+		line, len, cursor, ghost, ghost_len);
+
+	free(search);
 }
 
-void backspace(char* buf, int* cursor, int* len) {
-	int i;
+/*
+*	Ctrl-R, the line stays as it is underneath until a match is taken
+*/
+void search_start(input_state* inp) {
+	if (!inp->search)
+		inp->search = search_init(inp->history);
+
+	/* catch up with other sessions, unless we're in the middle of
+	 * browsing and entry numbers need to stay put */
+	if (inp->hiscur.pos == HISTORY_EDIT)
+		history_sync(inp->history);
+
+	inp->searching = true;
+	inp->search_failed = false;
+	inp->query[0] = '\0';
+	inp->query_len = 0;
+	inp->found = HISTORY_EDIT;
+
+	search_idle(inp);
+}
 
-	if (*cursor <= 0)
-		return;
+/*
+*	A key while searching. Returns false if it ended the search and
+*	should still be handled as usual, like enter or an arrow.
+*/
+bool search_key(input_state* inp, char c) {
+	size_t from, found;
 
-	/* move back one */
-	putc('\b', stdout);
+	switch (c) {
+	case CTRL('R'): /* next older match */
+		if (!inp->query_len || inp->found == HISTORY_EDIT)
+			return true;
+		from = inp->found;
+		break;
+	case CTRL('G'): /* give up, back to the line as it was */
+		search_end(inp, false);
+		return true;
+	case '\b':
+	case DEL:
+		if (inp->query_len)
+			inp->query[--inp->query_len] = '\0';
+		from = HISTORY_EDIT;
+		break;
+	default:
+		if (!isprint(c)) {
+			search_end(inp, true);
+			return false;
+		}
 
-	/* copy memory over the erased char */
-	memmove(&buf[*cursor - 1], &buf[*cursor], *len - *cursor + 1);
+		if (inp->query_len >= BUFFER_MAX_LENGTH - 1)
+			return true;
 
-	/* write over the old line */
-	for (i = *cursor - 1; i < *len; ++i) {
-		putc(buf[i], stdout);
+		inp->query[inp->query_len++] = c;
+		inp->query[inp->query_len] = '\0';
+		/* refining, the current match may still do */
+		from = (inp->found == HISTORY_EDIT) ? HISTORY_EDIT : inp->found + 1;
+		break;
 	}
 
-	/* erase extra character, left behind by memmove */
-	fputs(" \b", stdout);
-
-	while(i-- > *cursor)
-		putc('\b', stdout);
+	if (!inp->query_len) {
+		inp->found = HISTORY_EDIT;
+		inp->search_failed = false;
+	} else {
+		found = search_find(inp->search, inp->query, inp->query_len, from);
+		inp->search_failed = (found == HISTORY_EDIT);
+		if (!inp->search_failed)
+			inp->found = found;
+	}
 
-	--*cursor;
-	--*len;
-	fflush(stdout);
+	search_idle(inp);
+	return true;
 }
 
-#define ESC 27
-#define DEL 127
+void search_end(input_state* inp, bool accept) {
+	history *hist = inp->history;
 
-bool read_input(input_state* inp, char* buf) {
-	char c = 0;
-	int len, cursor;
-	int i;
-	int hislen;
-	int hispos = 0;
+	inp->searching = false;
 
-	cursor = inp->cursor;
-	len = strlen(buf);
+	if (!accept || inp->found == HISTORY_EDIT)
+		return;
 
-	while (true) {
-		if (!read(0, &c, 1)) {
-			inp->cursor = cursor;
-			return false;
-		}
+	/* so going down past the newest gets the typed line back */
+	if (inp->hiscur.pos == HISTORY_EDIT) {
+		free(inp->saved);
+		inp->saved = strdup(inp->buffer);
+	}
 
-		switch(c) {
-		case '\n':
-			return true;
-		case '\b':
-		case DEL:
-			backspace(buf, &cursor, &len);
-			break;
-		case ESC: /* escape char */
-			if (!read(0, &c, 1)) {
-				inp->cursor = cursor;
-				return false;
-			}
+	set_line(inp, history_get(hist, inp->found),
+		history_len(hist, inp->found));
 
-			if (c == '[') {
-				if (!read(0, &c, 1)) {
-					inp->cursor = cursor;
-					return false;
-				}
-				switch(c) {
-				case 'A': /* up */
-					hislen = history_travel(inp, buf, cursor, hispos, false);
-					if (hislen) {
-						++hispos;
-						cursor = len = hislen;
-					}
-					break;
-				case 'B': /* down */
-					hislen = history_travel(inp, buf, cursor, hispos, true);
-					if (hislen) {
-						--hispos;
-						cursor = len = hislen;
-					}
-					break;
-				case 'C': /* right */
-					if (cursor < len) {
-						++cursor;
-						fputs("\033[C", stdout);
-						fflush(stdout);
-					}
-					break;
-				case 'D': /* left */
-					if (cursor > 0) {
-						--cursor;
-						fputs("\033[D", stdout);
-						fflush(stdout);
-					}
-					break;
-				case '1': /* Ctrl-A */
-					break;
-				case '4': /* Ctrl-E */
-					break;
-				}
-			}
-			break;
-		default:
-			if (!isprint(c)) /* skip non-printables */
-				break;
+	/* up and down carry on from the match */
+	inp->hiscur.pos = inp->found;
+}
 
-			/* leave room for null terminator */
-			if (len >= (BUFFER_MAX_LENGTH - 1))
-				break;
+/*
+*	While searching, the index gets built a step at a time between
+*	keys instead of all at once on the first one
+*/
+void search_idle(input_state* inp) {
+	if (inp->indexing || !inp->searching || !psh->events)
+		return;
 
-			if (cursor == len) { /* EOL, append */
-				buf[cursor] = c;
-			} else { /* insert */
-				memmove(&buf[cursor + 1], &buf[cursor], len - cursor);
+	inp->indexing = event_timer(psh->events, 0, &search_tick, inp);
+}
 
-				buf[cursor] = c;
+void search_tick(int fd, void* data) {
+	input_state *inp = data;
 
-				/* write the changed rest of the line */
-				for (i = cursor; i <= len; ++i)
-					putc(buf[i], stdout);
-				for (; i > cursor; --i) /* move cursor back to original pos */
-					fputs("\033[D", stdout);
-			}
+	UNUSED(fd);
 
-			++cursor;
-			++len;
+	inp->indexing = false;
+	if (inp->searching && search_step(inp->search))
+		search_idle(inp);
+}
 
-			putc(c, stdout);
-			fflush(stdout);
-			break;
-		}
+/*
+*	Looks for the newest entry starting with the line, shown greyed
+*	out after it while typing at the end of a new line
+*/
+void suggest(input_state* inp) {
+	inp->suggestion = HISTORY_EDIT;
+
+	if (inp->cursor == inp->len && inp->len > 0 &&
+		inp->hiscur.pos == HISTORY_EDIT) {
+
+		inp->suggestion = history_suggest(inp->history, inp->buffer,
+			inp->len);
 	}
 }
+
+/* right arrow on a suggestion, takes it into the line */
+void accept_suggestion(input_state* inp) {
+	history *hist = inp->history;
+	int len = history_len(hist, inp->suggestion);
+
+	line_reserve(inp, len - inp->len);
+	memcpy(inp->buffer + inp->len,
+		history_get(hist, inp->suggestion) + inp->len, len - inp->len);
+	inp->buffer[len] = '\0';
+
+	inp->len = inp->cursor = len;
+	inp->suggestion = HISTORY_EDIT;
+}
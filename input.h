@@ -1,43 +1,123 @@
 #ifndef _INPUT_GUARD
 #define _INPUT_GUARD
 
+#include "arena.h"
+#include "history.h"
+
 #include <stdbool.h>
 #include <termios.h>
 
-/* POSIX minimum */
+/* how much gets read from the terminal at once, and the longest
+ * Ctrl-R search */
 #define BUFFER_MAX_LENGTH 4096
-#define MAX_COMMANDS 16
-#define MAX_ARGC 16
 
-typedef struct parsed_line {
-	char buffer[BUFFER_MAX_LENGTH];
-	char *argv[MAX_COMMANDS][MAX_ARGC];
+/* one command of a pipeline */
+typedef struct command {
+	/* NULL terminated */
+	char** argv;
+	int argc;
+
+	/* used for redirecting in/out of files */
+	char* in_file;
+	char* out_file;
+	/* >> instead of > */
+	bool append;
+} command;
+
+/* how a pipeline depends on the one before it */
+typedef enum pipe_cond {
+	COND_ALWAYS, /* first or after ; & */
+	COND_AND, /* after && */
+	COND_OR /* after || */
+} pipe_cond;
 
+typedef struct pipeline {
+	command* cmds;
 	int cmdc;
-	int argc[MAX_COMMANDS];
-} parsed_line;
 
-typedef struct history_line {
-	struct history_line* prev;
-	struct history_line* next;
+	pipe_cond cond;
+	bool background;
+} pipeline;
+
+/* everything in here lives in mem, freed when the last
+ * reference goes away in line_release */
+typedef struct parsed_line {
+	arena mem;
+
+	pipeline* pipes;
+	int pipec;
+	/* didn't parse, the error's been printed and pipec is 0 */
+	bool error;
 
-	char buffer[BUFFER_MAX_LENGTH];
-} history_line;
+	int refs;
+} parsed_line;
 
 typedef struct input_state {
 	struct termios attr;
 	struct termios attr_old;
 
+	/* where we are in history while editing */
+	history_cursor hiscur;
+	/* escape sequence parser state, carried between reads */
+	int esc;
+	int esc_param;
+
+	/* in unbuffered mode? */
+	bool raw;
+	/* stdin hit EOF */
+	bool closed;
+
+	/* line being edited, grows as needed */
+	char* buffer;
+	int len;
+	int cap;
 	int cursor;
+	/* the line as typed, kept while browsing history */
+	char* saved;
+
+	/* last read from the terminal, handled a key at a time */
+	char keys[BUFFER_MAX_LENGTH];
+	int key_pos;
+	int key_len;
+
+	/* inside a bracketed paste, collected until it ends */
+	bool pasting;
+	char* paste;
+	int paste_len;
+	int paste_cap;
+
+	/* ctrl-r search, what's been typed and the entry it found */
+	bool searching;
+	bool search_failed;
+	char query[BUFFER_MAX_LENGTH];
+	size_t query_len;
+	size_t found;
+	struct search_index* search;
+	/* an idle tick is queued to index more of history */
+	bool indexing;
+
+	/* autosuggestion shown after the line */
+	size_t suggestion;
+
+	/* what's on screen, and the prompt that goes in front of the line,
+	 * owned by whoever set it */
+	struct display* display;
+	char const* prompt;
 
-	history_line* history_first;
-	history_line* history_current;
+	history* history;
 } input_state;
 
 input_state* input_init(void);
 void input_destroy(input_state* input);
 
 parsed_line* input_process(input_state* input);
+bool input_pending(input_state* input);
+parsed_line* parse_input(char const* text);
+void line_release(parsed_line* line);
+void input_start(input_state* input);
+void input_prompt(input_state* input, char const* prompt);
+void input_repaint(input_state* input, char const* prompt);
+void input_resize(int fd, void* data);
 
 void input_restore(void);
 
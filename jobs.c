@@ -1,26 +1,48 @@
+/* for posix_spawn_file_actions_addtcsetpgrp_np */
+#define _GNU_SOURCE
+
 #include "jobs.h"
 
 #include "shell.h"
 #include "input.h"
 #include "builtin.h"
+#include "cmdhash.h"
+#include "forksrv.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <signal.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <spawn.h>
+
+/* posix_spawn can only hand the terminal over to the child since
+ * glibc 2.35, older libcs (or -DPSH_FORK) use the fork path */
+#if !defined(PSH_FORK) && defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define PSH_SPAWN
+#endif
 
-job* create_job(parsed_line* line, bool foreground, char* redir[][2]);
+job* create_job(parsed_line* line, pipeline* pl);
 void destroy_job(job* j);
 
 void launch_job(job* j);
-void launch_process(process* p, pid_t pgid, int in,
+pid_t start_process(process* p, pid_t pgid, int in, int out, int spare,
+	bool foreground);
+pid_t new_process(process* p, char const* path, pid_t pgid, int in,
+	int out, bool foreground);
+pid_t spawn_process(process* p, char const* path, pid_t pgid, int in,
+	int out, bool foreground);
+void launch_process(process* p, char const* path, pid_t pgid, int in,
 	int out, bool foreground) __attribute__ ((noreturn));
+void fork_builtin(builtin const* bin, process* p, pid_t pgid, int in,
+	int out, int spare, bool foreground) __attribute__ ((noreturn));
 
 void job_foreground(job* j);
 void job_background(job* j);
@@ -29,16 +51,50 @@ void job_wait(job* j);
 
 bool job_stopped(job* j);
 bool job_done(job* j);
+int job_status(job* j);
+
+bool job_report(job* j);
 
-void job_report(job* j);
+void pid_insert(jobs_state* jobs, process* p);
+void pid_remove(jobs_state* jobs, process* p);
+process* pid_find(jobs_state* jobs, pid_t pid);
 
 /*
 *	Public functions
 */
 
 jobs_state* jobs_init(void) {
+	sigset_t mask;
 	jobs_state *jobs = malloc(sizeof(jobs_state));
 	jobs->first_job = NULL;
+	jobs->status = 0;
+	jobs->waiting = false;
+
+	jobs->pid_buckets = 64;
+	jobs->pid_count = 0;
+	jobs->pids = calloc(jobs->pid_buckets, sizeof(process*));
+
+	jobs->hash = cmdhash_init();
+	jobs->forksrv = NULL;
+
+	/* SIGCHLD stays blocked for good, children are noticed through
+	 * the signalfd from the main loop instead of a signal handler */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	jobs->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (jobs->sigfd < 0) {
+		perror("psh: signalfd");
+		cmdhash_destroy(jobs->hash);
+		free(jobs->pids);
+		free(jobs);
+		return NULL;
+	}
+
+	/* after SIGCHLD is blocked, the server inherits that */
+	if (getenv("PSH_FORKSERVER"))
+		jobs->forksrv = forksrv_start();
 
 	return jobs;
 }
@@ -48,120 +104,93 @@ void jobs_destroy(jobs_state* jobs) {
 		destroy_job(jobs->first_job);
 	}
 
+	if (jobs->forksrv)
+		forksrv_stop(jobs->forksrv);
+
+	close(jobs->sigfd);
+	cmdhash_destroy(jobs->hash);
+	free(jobs->pids);
 	free(jobs);
 }
 
 /*
-*	Creates a job struct from given parsed_line
+*	Creates and launches a job for each pipeline of the line, && and ||
+*	look at the status of the last one that ran
 */
 void jobs_process(jobs_state* jobs, parsed_line* line) {
 	job *j, *last;
-	int i, k, argc;
-	char* argv[MAX_ARGC];
-	char* redir[MAX_COMMANDS][2] = {{NULL}};
-	bool foreground = true;
-
-	/* this should really be in parse_input, since redirection is
-	 * so similar to to piping, but oh well */
-	for (i = 0; i < line->cmdc; ++i) {
-		memcpy(argv, line->argv[i], sizeof(char*) * MAX_ARGC);
-
-		argc = line->argc[i];
-
-		/* we can skip the command name and last argument
-		 * since there can't be a filename after the bracket */
-		for (k = 1; k < argc - 1; ++k) {
-			if (argv[k][0] == '<') { /* stdin */
-				redir[i][0] = argv[k+1];
-				line->argv[i][k] = NULL;
-				if (k < line->argc[i])
-					line->argc[i] = k;
-				/* skip one arg */
-				++k;
-			} else if (argv[k][0] == '>') { /* stdout */
-				redir[i][1] = argv[k+1];
-				line->argv[i][k] = NULL;
-				if (k < line->argc[i])
-					line->argc[i] = k;
-				++k;
-			}
-		}
-		/* to make the amp-checking a bit simpler */
-		k = argc - 1;
-	}
+	pipeline *pl;
+	int i;
 
-	/* check the last cmd's larg arg for amp */
-	if (argv[k][0] == '&') {
-		foreground = false;
-		argv[k] = NULL;
-	}
+	/* exit stops the rest of the line too */
+	for (i = 0; i < line->pipec && psh->running; ++i) {
+		pl = &line->pipes[i];
 
-	/* TODO: a better way (a MUCH better way) */
-	/* last argument of the last command */
-	if (line->argv[line->cmdc-1][line->argc[line->cmdc-1] - 1][0] == '&') {
-		foreground = false;
+		if ((pl->cond == COND_AND && jobs->status != 0) ||
+			(pl->cond == COND_OR && jobs->status == 0))
+			continue;
 
-		/* remove ampersand (or whole last command if amp was the only arg) */
-		line->argv[line->cmdc-1][line->argc[line->cmdc-1] - 1] = NULL;
-		if (line->argc[line->cmdc-1] <= 1) {
-			--line->cmdc;
+		j = create_job(line, pl);
+		if (!jobs->first_job) {
+			jobs->first_job = j;
 		} else {
-			--line->argc[line->cmdc-1];
+			last = jobs->first_job;
+			while (last && last->next) {
+				last = last->next;
+			}
+			last->next = j;
 		}
-	}
 
-	j = create_job(line, foreground, redir);
-	if (!jobs->first_job) {
-		jobs->first_job = j;
-	} else {
-		last = jobs->first_job;
-		while (last && last->next) {
-			last = last->next;
-		}
-		last->next = j;
+		launch_job(j);
 	}
 
-	launch_job(j);
+	/* jobs hold their own references */
+	line_release(line);
 }
 
 /*
-*	SIGCHLD handler, updates job and process status
+*	SIGCHLD signalfd handler, updates job and process status.
+*	Signals coalesce, so one wakeup can mean any number of children.
 */
-void jobs_update(int pd) {
-	job *j;
+void jobs_update(int fd, void* data) {
+	struct signalfd_siginfo info;
+	jobs_state *jobs = data;
 	process *p;
 	int status;
-	pid_t pid = waitpid(WAIT_ANY, &status, WUNTRACED | WNOHANG);
+	pid_t pid;
+	bool restore = false;
 
-	UNUSED(pd);
+	/* consume the notification */
+	while (read(fd, &info, sizeof(info)) == sizeof(info)) {}
 
-	if (pid <= 0) {
-		return;
-	}
-
-	for (j = psh->jobs->first_job; j; j = j->next) {
-		for (p = j->first_proc; p; p = p->next) {
-			if (p->pid != pid)
-				continue;
+	/* reap everything that's ready, not just jobs, e.g. the prompt's
+	 * git runs leave it to us */
+	while ((pid = waitpid(WAIT_ANY, &status, WUNTRACED | WNOHANG)) > 0) {
+		if (!(p = pid_find(jobs, pid)))
+			continue;
 
-			p->status = status;
-			if (WIFSTOPPED(status)) {
-				p->stopped = true;
-			} else {
-				p->completed = true;
-				if (WIFSIGNALED(status)) {
-					fprintf(stderr, "%d: Terminated by signal %d.\n",
-						pid, WTERMSIG(p->status));
-				}
+		p->status = status;
+		if (WIFSTOPPED(status)) {
+			p->stopped = true;
+		} else {
+			p->completed = true;
+			pid_remove(jobs, p);
+			if (WIFSIGNALED(status)) {
+				fprintf(stderr, "%d: Terminated by signal %d.\n",
+					pid, WTERMSIG(p->status));
 			}
-
-			job_report(j);
-
-			return;
 		}
+
+		/* might destroy the job, p is gone after this */
+		if (job_report(p->job))
+			restore = true;
 	}
 
-	fprintf(stderr, "No child %d.\n", pid);
+	/* redraw the prompt once for the whole batch, unless something
+	 * else is using the terminal, then the prompt comes back once
+	 * it's done */
+	if (restore && psh->interactive && !jobs->waiting)
+		input_restore();
 }
 
 /*
@@ -173,6 +202,10 @@ void report(job* j, char const* status) {
 	char *arg;
 	int i;
 
+	/* scripts don't talk about their jobs */
+	if (!psh->interactive)
+		return;
+
 	fprintf(stderr, "\n%d (%s):", j->pgid, status);
 	for (p = j->first_proc; p; p = p->next) {
 		i = 1;
@@ -187,12 +220,12 @@ void report(job* j, char const* status) {
 
 /*
 *	reports job status back after completion and then destroys the job
-*	unless it's on foreground
+*	unless it's on foreground. Returns true if the prompt needs redrawing.
 */
-void job_report(job* j) {
+bool job_report(job* j) {
 	bool fg = j->foreground;
 	if (j->foreground && job_done(j)) {
-		return;
+		return false;
 	}
 
 	if (job_done(j)) {
@@ -200,10 +233,11 @@ void job_report(job* j) {
 		destroy_job(j);
 	} else if (job_stopped(j)) {
 		report(j, "suspended");
+	} else {
+		return false;
 	}
 
-	if (!fg)
-		input_restore();
+	return !fg;
 }
 
 /*
@@ -220,6 +254,25 @@ bool job_done(job* j) {
 	return true;
 }
 
+/*
+*	Exit status of the job, from its last process like sh does
+*/
+int job_status(job* j) {
+	process *p = j->first_proc;
+
+	while (p->next)
+		p = p->next;
+
+	if (WIFEXITED(p->status))
+		return WEXITSTATUS(p->status);
+	if (WIFSIGNALED(p->status))
+		return 128 + WTERMSIG(p->status);
+	if (WIFSTOPPED(p->status))
+		return 128 + WSTOPSIG(p->status);
+
+	return 0;
+}
+
 /*
 *	Job suspended?
 */
@@ -234,15 +287,54 @@ bool job_stopped(job* j) {
 	return true;
 }
 
-void launch_builtin(builtin const* bin, char* argv[]) {
-	int argc = 0;
-	char *arg = argv[0];
+int launch_builtin(builtin const* bin, char* argv[], int in, int out) {
+	builtin_io io;
+	int argc = 0, status;
+
+	/* "" is an argument too, test needs to see it */
+	while (argv[argc])
+		++argc;
+
+	io_init(&io, in, out);
+	status = bin->func(&io, argc, argv);
+	io_flush(&io);
+
+	return status;
+}
+
+/*
+*	A builtin on its own, run by the shell itself with its redirections
+*/
+int run_builtin(builtin const* bin, process* p) {
+	int in = STDIN_FILENO, out = STDOUT_FILENO, flags, status = 1;
+
+	if (p->in_file) {
+		in = open(p->in_file, O_RDONLY | O_CLOEXEC);
+		if (in < 0) {
+			perror("psh: in");
+			return 1;
+		}
+	}
 
-	while (arg && arg[0]) {
-		arg = argv[++argc];
+	if (p->out_file) {
+		flags = O_WRONLY | O_CREAT | O_CLOEXEC |
+			(p->append ? O_APPEND : O_TRUNC);
+		out = open(p->out_file, flags, 0666);
+		if (out < 0) {
+			perror("psh: out");
+			goto done;
+		}
 	}
 
-	bin->func(argc, argv);
+	status = launch_builtin(bin, p->argv, in, out);
+
+done:
+	if (in != STDIN_FILENO)
+		close(in);
+	if (out >= 0 && out != STDOUT_FILENO)
+		close(out);
+
+	return status;
 }
 
 /*
@@ -252,67 +344,79 @@ void launch_job(job* j) {
 	builtin const *bin;
 	process *p;
 	pid_t pid;
-	int fd[2], in, out;
-
-	/* thanks, builtins */
-	/* thuiltins */
-	if ((bin = builtin_get(j->first_proc->argv[0]))) {
-		if (j->foreground && !j->first_proc->next) {
-			launch_builtin(bin, j->first_proc->argv);
-			destroy_job(j);
-		}
+	int fd[2], in, out, spare, flags;
+	bool announce = !j->foreground && psh->interactive;
+
+	/* a builtin on its own runs in the shell itself, so cd and friends
+	 * work. In a pipeline or the background it gets forked like any
+	 * other process, see start_process. */
+	bin = builtin_get(j->first_proc->argv[0]);
+	if (bin && j->foreground && !j->first_proc->next) {
+		psh->jobs->status = run_builtin(bin, j->first_proc);
+		destroy_job(j);
 		return;
 	}
 
-	if (!j->foreground)
+	if (announce)
 		printf("[%d]", j->id);
 
 	/* start with non-pipe stdin */
 	in = j->stdin;
-	if (j->first_proc && j->first_proc->in_file) {
-		in = open(j->first_proc->in_file, O_RDONLY);
-		if (in < 0) {
-			perror("psh: in");
-			return;
-		}
-	}
 	for (p = j->first_proc; p; p = p->next) {
-		/* redirect output unless it's the last proc */
+		out = spare = -1;
+
+		/* a file replaces whatever the previous command piped in */
+		if (p->in_file) {
+			if (in != j->stdin)
+				close(in);
+			in = open(p->in_file, O_RDONLY | O_CLOEXEC);
+			if (in < 0) {
+				perror("psh: in");
+				goto fail;
+			}
+		}
+
+		/* redirect output unless it's the last proc. Close-on-exec, so
+		 * a stage only keeps the ends it got as stdin/stdout and the
+		 * read end doesn't leak into the writer. */
 		if (p->next) {
-			if (pipe(fd) < 0) {
+			if (pipe2(fd, O_CLOEXEC) < 0) {
 				perror("PSH-pipe");
-				return;
+				goto fail;
 			}
 			out = fd[STDOUT_FILENO];
+			spare = fd[STDIN_FILENO];
 		} else {
 			out = j->stdout;
 		}
 		if (p->out_file) {
-			/* we don't need stdin if we have a file in-between */
+			/* we don't need the pipe if we have a file in-between */
+			flags = O_CREAT | O_CLOEXEC |
+				(p->append ? O_APPEND : O_TRUNC);
 			if (p->next) {
-				close(fd[STDIN_FILENO]);
-				out = open(p->out_file, O_RDWR | O_CREAT | O_TRUNC);
+				close(spare);
+				close(out);
+				spare = -1;
+				out = open(p->out_file, O_RDWR | flags, 0666);
 			} else {
-				out = open(p->out_file, O_WRONLY | O_CREAT | O_TRUNC);
+				out = open(p->out_file, O_WRONLY | flags, 0666);
 			}
 
 			if (out < 0) {
 				perror("psh: out");
-				return;
+				goto fail;
 			}
 		}
 
-		pid = fork();
+		pid = start_process(p, j->pgid, in, out, spare, j->foreground);
 
-		if (pid == 0) { /* child proc */
-			launch_process(p, j->pgid, in, out, j->foreground);
-		} else if (pid < 0) { /* fork failed */
-			perror("PSH-fork");
-			return;
-		} else { /* in parent */
-			if (!j->foreground)
+		if (pid < 0) { /* fork failed */
+			goto fail;
+		} else if (pid > 0) { /* started */
+			if (announce)
 				printf(" %d", pid);
 			p->pid = pid;
+			pid_insert(psh->jobs, p);
 			/* if no group id for children yet, first child becomes leader */
 			if (!j->pgid)
 				j->pgid = pid;
@@ -333,40 +437,239 @@ void launch_job(job* j) {
 		else {
 			if (out != j->stdout)
 				close(out);
-			in = fd[STDIN_FILENO];
+			in = spare;
 		}
 	}
 
-	if (!j->foreground)
+	if (announce)
 		printf("\n");
 
 	if (j->foreground)
 		job_foreground(j);
 	else
 		job_background(j);
+	return;
+
+fail:
+	/* whatever got opened for the stage that failed */
+	if (in >= 0 && in != j->stdin)
+		close(in);
+	if (out >= 0 && out != j->stdout)
+		close(out);
+	if (spare >= 0)
+		close(spare);
+
+	if (announce)
+		printf("\n");
+
+	/* it and everything after it never ran, same as a failed exec */
+	for (; p; p = p->next) {
+		p->completed = true;
+		p->status = 1 << 8;
+	}
+	psh->jobs->status = 1;
+
+	/* earlier stages that did start still get waited for */
+	if (job_done(j))
+		destroy_job(j);
+	else if (j->foreground)
+		job_foreground(j);
+	else
+		job_background(j);
 }
 
 /*
-*	sets child's signals, pgid, dup2's stdio
+*	Starts one process of a pipeline. Returns its pid, 0 if the program
+*	couldn't be run (p is marked completed, like a child that failed to
+*	exec) or -1 if we couldn't create a process at all. spare is the
+*	read end of p's output pipe (or -1), exec closes it for programs.
 */
-void launch_process(process* p, pid_t pgid, int in,
+pid_t start_process(process* p, pid_t pgid, int in, int out, int spare,
+	bool foreground) {
+
+	forksrv *srv = psh->jobs->forksrv;
+	builtin const *bin;
+	char const *path;
+	pid_t pid = -1;
+
+	if ((bin = builtin_get(p->argv[0]))) {
+		/* or the child prints whatever we still have buffered too */
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0)
+			fork_builtin(bin, p, pgid, in, out, spare, foreground);
+		if (pid < 0)
+			perror("PSH-fork");
+		return pid;
+	}
+
+	/* resolved here, so the child can exec it directly instead of
+	 * trying every $PATH entry */
+	if (!(path = cmdhash_find(psh->jobs->hash, p->argv[0]))) {
+		fprintf(stderr, "psh: %s: command not found\n", p->argv[0]);
+		p->completed = true;
+		p->status = 127 << 8;
+		return 0;
+	}
+
+	if (srv && !srv->dead)
+		pid = forksrv_spawn(srv, path, p->argv, pgid, psh->term, in, out,
+			foreground);
+
+	/* no fork server, or it just went away */
+	if (!srv || srv->dead)
+		pid = new_process(p, path, pgid, in, out, foreground);
+
+	if (pid < 0)
+		perror("PSH-fork");
+
+	return pid;
+}
+
+/*
+*	Starts a program from the shell itself
+*/
+pid_t new_process(process* p, char const* path, pid_t pgid, int in,
+	int out, bool foreground) {
+
+	pid_t pid;
+
+#ifdef PSH_SPAWN
+	pid = spawn_process(p, path, pgid, in, out, foreground);
+#else
+	pid = fork();
+	if (pid == 0) /* child proc */
+		launch_process(p, path, pgid, in, out, foreground);
+#endif
+
+	return pid;
+}
+
+#ifdef PSH_SPAWN
+/*
+*	posix_spawn version of launch_process. glibc runs the child with
+*	CLONE_VM | CLONE_VFORK, so there's no page table copy of the
+*	shell's memory, which is most of the cost of a fork.
+*/
+pid_t spawn_process(process* p, char const* path, pid_t pgid, int in,
+	int out, bool foreground) {
+
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_t actions;
+	sigset_t sigs;
+	pid_t pid = -1;
+	int err;
+
+	posix_spawnattr_init(&attr);
+	posix_spawn_file_actions_init(&actions);
+
+	/* same as launch_process: own group, default signals, nothing
+	 * blocked (SIGCHLD is blocked in the shell for the signalfd) */
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+		POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+	posix_spawnattr_setpgroup(&attr, pgid);
+
+	sigemptyset(&sigs);
+	posix_spawnattr_setsigmask(&attr, &sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGQUIT);
+	sigaddset(&sigs, SIGTSTP);
+	sigaddset(&sigs, SIGTTIN);
+	sigaddset(&sigs, SIGTTOU);
+	sigaddset(&sigs, SIGCHLD);
+	posix_spawnattr_setsigdefault(&attr, &sigs);
+
+	/* runs after setpgid, with signals still blocked in the child */
+	if (foreground && psh->term >= 0)
+		posix_spawn_file_actions_addtcsetpgrp_np(&actions, psh->term);
+
+	if (in != STDIN_FILENO) {
+		posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+		posix_spawn_file_actions_addclose(&actions, in);
+	}
+	if (out != STDOUT_FILENO) {
+		posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+		posix_spawn_file_actions_addclose(&actions, out);
+	}
+
+	err = posix_spawn(&pid, path, &actions, &attr, p->argv, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	if (err) {
+		/* exec errors get reported back to us, not the child */
+		fprintf(stderr, "psh: exec: %s\n", strerror(err));
+		p->completed = true;
+		p->status = 127 << 8;
+		return 0;
+	}
+
+	return pid;
+}
+#endif
+
+void launch_process(process* p, char const* path, pid_t pgid, int in,
 	int out, bool foreground) {
 
+	jobs_setup_child(pgid, psh->term, in, out, foreground);
+
+	execv(path, p->argv);
+	perror("psh: exec");
+	exit(EXIT_FAILURE);
+}
+
+/*
+*	A builtin in a pipeline or the background, runs in the forked
+*	shell with the pipeline's stdio, no exec needed. Nothing gets
+*	closed on exec either, so the read end of our own output has to go
+*	by hand or we'd never get SIGPIPE.
+*/
+void fork_builtin(builtin const* bin, process* p, pid_t pgid, int in,
+	int out, int spare, bool foreground) {
+
+	int status;
+
+	if (spare >= 0)
+		close(spare);
+	jobs_setup_child(pgid, psh->term, in, out, foreground);
+
+	status = launch_builtin(bin, p->argv, STDIN_FILENO, STDOUT_FILENO);
+
+	/* not exit, the shell's atexit handlers aren't ours to run */
+	fflush(stdout);
+	_exit(status);
+}
+
+/*
+*	sets child's signals, pgid, dup2's stdio. Also used by the fork
+*	server, which has no psh, so the terminal gets passed in.
+*/
+void jobs_setup_child(pid_t pgid, int term, int in, int out,
+	bool foreground) {
+
 	pid_t pid = getpid();
+	sigset_t mask;
 
 	if (!pgid)
 		pgid = pid;
 
 	setpgid(pid, pgid);
-	if (foreground)
-		tcsetpgrp(psh->term, pgid);
+	if (foreground && term >= 0)
+		tcsetpgrp(term, pgid);
 
 	signal(SIGINT,  SIG_DFL);
 	signal(SIGQUIT, SIG_DFL);
 	signal(SIGTSTP, SIG_DFL);
 	signal(SIGTTIN, SIG_DFL);
 	signal(SIGTTOU, SIG_DFL);
-	signal(SIGCHLD, &jobs_update);
+	signal(SIGCHLD, SIG_DFL);
+
+	/* blocked for the signalfds, don't leak that into the program */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGWINCH);
+	sigprocmask(SIG_UNBLOCK, &mask, NULL);
 
 	if (in != STDIN_FILENO) {
 		dup2(in, STDIN_FILENO);
@@ -376,75 +679,89 @@ void launch_process(process* p, pid_t pgid, int in,
 		dup2(out, STDOUT_FILENO);
 		close(out);
 	}
-
-	execvp(p->argv[0], p->argv);
-	perror("psh: exec");
-	exit(EXIT_FAILURE);
 }
 
 void job_foreground(job* j) {
-	tcsetpgrp(psh->term, j->pgid);
+	if (psh->term >= 0)
+		tcsetpgrp(psh->term, j->pgid);
 
 	job_wait(j);
 
-	tcsetpgrp(psh->term, psh->pgid);
+	if (psh->term >= 0)
+		tcsetpgrp(psh->term, psh->pgid);
 }
 
 void job_background(job* j) {
 	UNUSED(j);
 }
 
-/* used for foreground job */
+/*
+*	used for foreground job, sleeps on the SIGCHLD signalfd until every
+*	process has completed (or the job got stopped)
+*/
 void job_wait(job* j) {
-	do {}
-	while (!job_done(j));
+	struct pollfd pfd;
 
-	destroy_job(j);
+	pfd.fd = psh->jobs->sigfd;
+	pfd.events = POLLIN;
+
+	psh->jobs->waiting = true;
+	while (!job_done(j) && !job_stopped(j)) {
+		if (poll(&pfd, 1, -1) > 0)
+			jobs_update(pfd.fd, psh->jobs);
+	}
+	psh->jobs->waiting = false;
+
+	psh->jobs->status = job_status(j);
+
+	if (job_done(j)) {
+		destroy_job(j);
+	} else {
+		/* suspended, already reported by jobs_update; treat it as a
+		 * background job so it gets reported and cleaned up when done */
+		j->foreground = false;
+	}
 }
 
-job* create_job(parsed_line* line, bool foreground, char* redir[][2]) {
+job* create_job(parsed_line* line, pipeline* pl) {
 	static int id = 1;
-	process *p, *tmpp;
+	process *p, **tail;
 	job *j = malloc(sizeof(job));
 	j->next = NULL;
 	j->id = id++;
 	j->line = line;
-	j->pgid = 0;
-	j->foreground = foreground;
+	++line->refs;
+	/* without a terminal there's no job control, everything stays in
+	 * our group so ^C reaches it */
+	j->pgid = psh->term >= 0 ? 0 : psh->pgid;
+	j->foreground = !pl->background;
 	j->stdin = STDIN_FILENO;
 	j->stdout = STDOUT_FILENO;
 	j->stderr = STDERR_FILENO;
 	int i;
 
-	for (i = 0; i < line->cmdc; ++i) {
+	/* appended through the last next pointer, long pipelines
+	 * shouldn't walk the list for every stage */
+	tail = &j->first_proc;
+	for (i = 0; i < pl->cmdc; ++i) {
 		p = malloc(sizeof(process));
-		if (i == 0) {
-			j->first_proc = p;
-		}
-		else {
-			tmpp = j->first_proc;
-			while (tmpp && tmpp->next)
-				tmpp = tmpp->next;
-			tmpp->next = p;
-		}
+		*tail = p;
+		tail = &p->next;
 
 		p->next = NULL;
-		memcpy(p->argv, line->argv[i], sizeof(char*) * MAX_ARGC);
+		p->hnext = NULL;
+		p->job = j;
+		/* argv and redirections point into the line */
+		p->argv = pl->cmds[i].argv;
 		p->pid = 0;
 		p->completed = false;
 		p->stopped = false;
 		p->status = 0;
-		p->in_file = NULL;
-		p->out_file = NULL;
-
-		/* check redirs */
-		if (redir[i][0]) {
-			p->in_file = strdup(redir[i][0]);
-		}
-		if (redir[i][1]) {
-			p->out_file = strdup(redir[i][1]);
-		}
+		p->in_file = pl->cmds[i].in_file;
+		p->out_file = pl->cmds[i].out_file;
+		p->append = pl->cmds[i].append;
 	}
+	*tail = NULL;
 
 	return j;
 }
@@ -456,8 +773,8 @@ void destroy_job(job* j) {
 	p = j->first_proc;
 	while (p) {
 		pnext = p->next;
-		free(p->in_file);
-		free(p->out_file);
+		if (p->pid && !p->completed)
+			pid_remove(psh->jobs, p);
 		free(p);
 		p = pnext;
 	}
@@ -477,6 +794,56 @@ void destroy_job(job* j) {
 		}
 	}
 
-	free(j->line);
+	line_release(j->line);
 	free(j);
 }
+
+/*
+*	pid -> process table, so reaping doesn't scan every job
+*/
+void pid_insert(jobs_state* jobs, process* p) {
+	process **old = jobs->pids;
+	process *q, *next;
+	int i, n = jobs->pid_buckets;
+
+	if (jobs->pid_count >= jobs->pid_buckets) {
+		/* grow and rehash */
+		jobs->pid_buckets *= 2;
+		jobs->pids = calloc(jobs->pid_buckets, sizeof(process*));
+		for (i = 0; i < n; ++i) {
+			for (q = old[i]; q; q = next) {
+				next = q->hnext;
+				q->hnext = jobs->pids[q->pid & (jobs->pid_buckets - 1)];
+				jobs->pids[q->pid & (jobs->pid_buckets - 1)] = q;
+			}
+		}
+		free(old);
+	}
+
+	i = p->pid & (jobs->pid_buckets - 1);
+	p->hnext = jobs->pids[i];
+	jobs->pids[i] = p;
+	++jobs->pid_count;
+}
+
+void pid_remove(jobs_state* jobs, process* p) {
+	process **q = &jobs->pids[p->pid & (jobs->pid_buckets - 1)];
+
+	for (; *q; q = &(*q)->hnext) {
+		if (*q == p) {
+			*q = p->hnext;
+			p->hnext = NULL;
+			--jobs->pid_count;
+			return;
+		}
+	}
+}
+
+process* pid_find(jobs_state* jobs, pid_t pid) {
+	process *p = jobs->pids[pid & (jobs->pid_buckets - 1)];
+
+	while (p && p->pid != pid)
+		p = p->hnext;
+
+	return p;
+}
@@ -9,8 +9,12 @@
 
 typedef struct process {
 	struct process* next;
+	/* next in the same pid bucket */
+	struct process* hnext;
+	struct job* job;
 
-	char* argv[MAX_ARGC];
+	/* owned by the job's parsed_line */
+	char** argv;
 
 	pid_t pid;
 	bool completed;
@@ -19,6 +23,7 @@ typedef struct process {
 	/* used for redirecting in/out of files */
 	char* in_file;
 	char* out_file;
+	bool append;
 
 	int status;
 } process;
@@ -36,8 +41,29 @@ typedef struct job {
 	process* first_proc;
 } job;
 
+struct cmdhash;
+struct forksrv;
+
 typedef struct jobs_state {
 	job* first_job;
+
+	/* where commands live in $PATH */
+	struct cmdhash* hash;
+	/* starts programs for us if $PSH_FORKSERVER is set, else NULL */
+	struct forksrv* forksrv;
+
+	/* running processes by pid, power of two buckets */
+	process** pids;
+	int pid_buckets;
+	int pid_count;
+
+	/* exit status of the last foreground job, for && and || */
+	int status;
+	/* a foreground job owns the terminal, leave it alone */
+	bool waiting;
+
+	/* signalfd for SIGCHLD */
+	int sigfd;
 } jobs_state;
 
 jobs_state* jobs_init(void);
@@ -45,6 +71,9 @@ void jobs_destroy(jobs_state* jobs);
 
 void jobs_process(jobs_state* jobs, parsed_line* line);
 
-void jobs_update(int pd);
+void jobs_update(int fd, void* data);
+
+void jobs_setup_child(pid_t pgid, int term, int in, int out,
+	bool foreground);
 
 #endif
@@ -0,0 +1,256 @@
+#include "lex.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* character classes, everything not listed is part of a plain word */
+enum {
+	CC_WORD = 0,
+	CC_END,
+	CC_BLANK,
+	CC_NEWLINE,
+	CC_OP,
+	CC_SQUOTE,
+	CC_DQUOTE,
+	CC_ESCAPE
+};
+
+/* plain_run's SSE2 path checks for exactly these, keep them in sync */
+static const unsigned char cclass[256] = {
+	['\0'] = CC_END,
+	[' '] = CC_BLANK,
+	['\t'] = CC_BLANK,
+	['\n'] = CC_NEWLINE,
+	['|'] = CC_OP,
+	['&'] = CC_OP,
+	[';'] = CC_OP,
+	['<'] = CC_OP,
+	['>'] = CC_OP,
+	['\''] = CC_SQUOTE,
+	['"'] = CC_DQUOTE,
+	['\\'] = CC_ESCAPE
+};
+
+/* reads whole aligned blocks past the end of the string, which is
+ * fine but ASan can't know that */
+size_t plain_run(char const* s) __attribute__ ((no_sanitize_address));
+token_type lex_op(lexer* lx);
+token_type lex_word(lexer* lx);
+
+/*
+*	Public functions
+*/
+
+void lex_init(lexer* lx, char const* src, char* out) {
+	lx->pos = src;
+	lx->out = out;
+	lx->word = NULL;
+}
+
+/*
+*	Returns the next token, words are unquoted into lx->word
+*/
+token_type lex_next(lexer* lx) {
+	char const *c = lx->pos;
+
+	while (cclass[(unsigned char)*c] == CC_BLANK)
+		++c;
+
+	/* comment, only at the start of a word */
+	if (*c == '#') {
+		while (*c && *c != '\n')
+			++c;
+	}
+
+	lx->pos = c;
+
+	switch (cclass[(unsigned char)*c]) {
+	case CC_END:
+		return TOK_END;
+	case CC_NEWLINE:
+		++lx->pos;
+		return TOK_NEWLINE;
+	case CC_OP:
+		return lex_op(lx);
+	default:
+		return lex_word(lx);
+	}
+}
+
+char const* lex_name(token_type type) {
+	switch (type) {
+	case TOK_END: return "newline";
+	case TOK_ERROR: return "error";
+	case TOK_WORD: return "word";
+	case TOK_PIPE: return "|";
+	case TOK_REDIR_IN: return "<";
+	case TOK_REDIR_OUT: return ">";
+	case TOK_REDIR_APPEND: return ">>";
+	case TOK_AMP: return "&";
+	case TOK_SEMI: return ";";
+	case TOK_NEWLINE: return "newline";
+	case TOK_AND_IF: return "&&";
+	case TOK_OR_IF: return "||";
+	}
+
+	return "?";
+}
+
+/*
+*	Private functions
+*/
+
+#ifdef __SSE2__
+/* bit set for every byte in the block that isn't a plain word char */
+static inline unsigned int special_mask(__m128i v) {
+	__m128i m;
+
+	m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+
+	return (unsigned int)_mm_movemask_epi8(m);
+}
+#endif
+
+/*
+*	Length of the run of plain word chars starting at s
+*/
+size_t plain_run(char const* s) {
+#ifdef __SSE2__
+	/* aligned loads never cross into the next page, so reading past
+	 * the terminator is fine, same trick as strlen */
+	uintptr_t off = (uintptr_t)s & 15;
+	__m128i const *v = (__m128i const*)(s - off);
+	unsigned int mask = special_mask(_mm_load_si128(v)) >> off;
+
+	if (mask)
+		return __builtin_ctz(mask);
+
+	for (++v; !(mask = special_mask(_mm_load_si128(v))); ++v) {}
+
+	return (char const*)v - s + __builtin_ctz(mask);
+#else
+	char const *c = s;
+
+	while (cclass[(unsigned char)*c] == CC_WORD)
+		++c;
+
+	return c - s;
+#endif
+}
+
+token_type lex_op(lexer* lx) {
+	char const *c = lx->pos;
+	token_type type;
+
+	switch (*c) {
+	case '|':
+		type = (c[1] == '|') ? TOK_OR_IF : TOK_PIPE;
+		break;
+	case '&':
+		type = (c[1] == '&') ? TOK_AND_IF : TOK_AMP;
+		break;
+	case '>':
+		type = (c[1] == '>') ? TOK_REDIR_APPEND : TOK_REDIR_OUT;
+		break;
+	case '<':
+		type = TOK_REDIR_IN;
+		break;
+	default:
+		type = TOK_SEMI;
+		break;
+	}
+
+	if (type == TOK_OR_IF || type == TOK_AND_IF || type == TOK_REDIR_APPEND)
+		lx->pos += 2;
+	else
+		lx->pos += 1;
+
+	return type;
+}
+
+/*
+*	Reads a word, removing quotes and escapes as it goes
+*/
+token_type lex_word(lexer* lx) {
+	char const *c = lx->pos;
+	char *out = lx->out;
+	size_t n;
+
+	lx->word = out;
+
+	while (true) {
+		/* the common case, plain chars. Most words are short and a
+		 * byte loop beats setting up the SSE2 scan, so that only
+		 * starts once a run gets long */
+		for (n = 0; n < 16 && cclass[(unsigned char)c[n]] == CC_WORD; ++n)
+			out[n] = c[n];
+		if (n == 16) {
+			n += plain_run(c + 16);
+			memcpy(out + 16, c + 16, n - 16);
+		}
+		out += n;
+		c += n;
+
+		switch (cclass[(unsigned char)*c]) {
+		case CC_SQUOTE:
+			/* everything literal up to the next ' */
+			for (++c; *c && *c != '\''; )
+				*out++ = *c++;
+			if (!*c)
+				goto unterminated;
+			++c;
+			break;
+		case CC_DQUOTE:
+			for (++c; *c && *c != '"'; ) {
+				/* only these can be escaped in double quotes */
+				if (*c == '\\' && (c[1] == '"' || c[1] == '\\' ||
+					c[1] == '$' || c[1] == '`')) {
+					++c;
+				} else if (*c == '\\' && c[1] == '\n') {
+					c += 2;
+					continue;
+				}
+				*out++ = *c++;
+			}
+			if (!*c)
+				goto unterminated;
+			++c;
+			break;
+		case CC_ESCAPE:
+			++c;
+			if (*c == '\n') /* line continuation */
+				++c;
+			else if (*c)
+				*out++ = *c++;
+			break;
+		default:
+			/* blank, operator or end */
+			*out++ = '\0';
+			lx->out = out;
+			lx->pos = c;
+			return TOK_WORD;
+		}
+	}
+
+unterminated:
+	lx->pos = c;
+	lx->word = "unterminated quote";
+	return TOK_ERROR;
+}
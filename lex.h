@@ -0,0 +1,36 @@
+#ifndef _LEX_GUARD
+#define _LEX_GUARD
+
+typedef enum token_type {
+	TOK_END,
+	TOK_ERROR,
+	TOK_WORD,
+	TOK_PIPE, /* | */
+	TOK_REDIR_IN, /* < */
+	TOK_REDIR_OUT, /* > */
+	TOK_REDIR_APPEND, /* >> */
+	TOK_AMP, /* & */
+	TOK_SEMI, /* ; */
+	TOK_NEWLINE, /* ends a command like ; but can follow | && || */
+	TOK_AND_IF, /* && */
+	TOK_OR_IF /* || */
+} token_type;
+
+typedef struct lexer {
+	char const* pos;
+
+	/* unquoted words get written here, needs room for
+	 * strlen(src) + 1 bytes, each NUL takes the place of whatever
+	 * ended the word */
+	char* out;
+
+	/* text of the last TOK_WORD, or what went wrong on TOK_ERROR */
+	char const* word;
+} lexer;
+
+void lex_init(lexer* lx, char const* src, char* out);
+token_type lex_next(lexer* lx);
+
+char const* lex_name(token_type type);
+
+#endif
@@ -1,11 +1,42 @@
 #include "shell.h"
+#include "jobs.h"
+#include "forksrv.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 shell_state *psh = NULL;
 
-int main() {
-	bool ok = (psh = shell_init());
+int main(int argc, char* argv[]) {
+	bool ok;
+	int status;
+
+	/* started by the shell to fork for it */
+	if (argc == 2 && strcmp(argv[1], FORKSRV_ARG) == 0)
+		return forksrv_main();
+
+	/* psh -c commands, psh script or commands piped in */
+	if (argc > 1 || !isatty(STDIN_FILENO)) {
+		if (!(psh = shell_init_batch()))
+			return -1;
+
+		if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+			if (argc > 2) {
+				status = shell_eval(psh, argv[2]);
+			} else {
+				fprintf(stderr, "psh: -c: needs an argument\n");
+				status = 2;
+			}
+		} else {
+			status = shell_source(psh, argc > 1 ? argv[1] : NULL);
+		}
+
+		shell_destroy(psh);
+		return status;
+	}
+
+	ok = (psh = shell_init());
 
 	if (!ok) {
 		return -1;
@@ -15,6 +46,7 @@ int main() {
 		ok = shell_cmdloop(psh);
 	}
 
+	status = psh->jobs->status;
 	shell_destroy(psh);
-	return 0;
+	return status;
 }
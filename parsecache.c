@@ -0,0 +1,74 @@
+#include "parsecache.h"
+
+#include "strmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void release_cached(void* line);
+
+/*
+*	Public functions
+*/
+
+parsecache* parsecache_init(void) {
+	parsecache *cache = malloc(sizeof(parsecache));
+
+	cache->lines = strmap_init();
+	memset(cache->seen, 0, sizeof(cache->seen));
+
+	return cache;
+}
+
+void parsecache_destroy(parsecache* cache) {
+	strmap_destroy(cache->lines, &release_cached);
+	free(cache);
+}
+
+/*
+*	Same as parse_input, but the caller gets a new reference to the
+*	cached parse if text has been run before. Lines that didn't parse
+*	aren't kept, so their errors show up every time.
+*/
+parsed_line* parse_cached(parsecache* cache, char const* text) {
+	parsed_line *line;
+	unsigned int hash, *seen;
+
+	if ((line = strmap_get(cache->lines, text))) {
+		++line->refs;
+		return line;
+	}
+
+	line = parse_input(text);
+	if (line->pipec == 0)
+		return line;
+
+	/* first time, or pushed out by another line with the same slot */
+	hash = strmap_hash(text);
+	seen = &cache->seen[hash & (PARSECACHE_SEEN - 1)];
+	if (*seen != hash) {
+		*seen = hash;
+		return line;
+	}
+
+	/* many different lines that repeat would grow it forever */
+	if (cache->lines->count >= PARSECACHE_MAX)
+		parsecache_clear(cache);
+
+	++line->refs;
+	strmap_put(cache->lines, text, line);
+
+	return line;
+}
+
+void parsecache_clear(parsecache* cache) {
+	strmap_clear(cache->lines, &release_cached);
+}
+
+/*
+*	Private functions
+*/
+
+void release_cached(void* line) {
+	line_release(line);
+}
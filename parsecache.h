@@ -0,0 +1,33 @@
+#ifndef _PARSECACHE_GUARD
+#define _PARSECACHE_GUARD
+
+#include "input.h"
+
+struct strmap;
+
+/* the most lines kept before starting over */
+#define PARSECACHE_MAX 256
+/* slots for hashes of recently parsed lines, a power of two */
+#define PARSECACHE_SEEN 1024
+
+/*
+*	Source text -> parsed_line, for lines that get run again and again
+*	(! n, the same line over and over in a script). Parsed lines are
+*	never changed after parsing, so the cache and any jobs just share
+*	them by reference.
+*/
+typedef struct parsecache {
+	struct strmap* lines;
+
+	/* a line only gets cached the second time it's parsed, so lines
+	 * that never come back don't cost a copy and an entry */
+	unsigned int seen[PARSECACHE_SEEN];
+} parsecache;
+
+parsecache* parsecache_init(void);
+void parsecache_destroy(parsecache* cache);
+
+parsed_line* parse_cached(parsecache* cache, char const* text);
+void parsecache_clear(parsecache* cache);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+*	Sample plugin, a few small things that are cheaper as builtins
+*	than as programs. Build and load with
+*
+*	gcc -shared -fPIC -I. plugins/sample.c -o sample.so
+*	load ./sample.so
+*/
+#include "builtin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/* everything but psh_builtins is static, or the shell's own symbols
+ * (psh is linked -rdynamic) could take their place */
+static int plugin_sum(builtin_io* io, int argc, char* argv[]);
+static int plugin_jget(builtin_io* io, int argc, char* argv[]);
+static int plugin_counter(builtin_io* io, int argc, char* argv[]);
+
+builtin const psh_builtins[] = {
+	{"sum", plugin_sum},
+	{"jget", plugin_jget},
+	{"counter", plugin_counter},
+	{NULL, NULL}
+};
+
+/* whole of fd into a malloc'd string, NULL on errors */
+static char* read_all(int fd, size_t* len) {
+	char *buf = NULL;
+	size_t cap = 0;
+	ssize_t n;
+
+	*len = 0;
+	do {
+		if (*len + 4096 + 1 > cap) {
+			cap = cap ? cap * 2 : 8192;
+			buf = realloc(buf, cap);
+		}
+
+		n = read(fd, buf + *len, cap - *len - 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			free(buf);
+			return NULL;
+		}
+		*len += n;
+	} while (n != 0);
+
+	buf[*len] = '\0';
+	return buf;
+}
+
+/* 32-bit FNV-1a, same as the shell's own hash tables */
+static uint32_t fnv1a(char const* s, size_t len) {
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/*
+*	sum [file...]: FNV-1a checksum and size of each file, or stdin
+*/
+static int plugin_sum(builtin_io* io, int argc, char* argv[]) {
+	char *data;
+	size_t len;
+	int i, fd, status = 0;
+
+	for (i = 1; i < argc || i == 1; ++i) {
+		fd = i < argc ? open(argv[i], O_RDONLY | O_CLOEXEC) : io->in;
+		if (fd < 0) {
+			fprintf(stderr, "sum: %s: %s\n", argv[i], strerror(errno));
+			status = 1;
+			continue;
+		}
+
+		data = read_all(fd, &len);
+		if (fd != io->in)
+			close(fd);
+
+		if (!data) {
+			fprintf(stderr, "sum: %s\n", strerror(errno));
+			status = 1;
+			continue;
+		}
+
+		io_printf(io, "%08x %zu%s%s\n", fnv1a(data, len), len,
+			i < argc ? " " : "", i < argc ? argv[i] : "");
+		free(data);
+	}
+
+	return status;
+}
+
+/* past a JSON string starting at its opening quote */
+static char const* skip_string(char const* s) {
+	for (++s; *s && *s != '"'; ++s) {
+		if (*s == '\\' && s[1])
+			++s;
+	}
+
+	return *s ? s + 1 : s;
+}
+
+/* past any JSON value */
+static char const* skip_value(char const* s) {
+	int depth = 0;
+
+	do {
+		if (*s == '"') {
+			s = skip_string(s);
+			continue;
+		}
+
+		if (*s == '{' || *s == '[')
+			++depth;
+		else if (*s == '}' || *s == ']')
+			--depth;
+		else if (depth == 0 && (*s == ',' || *s == ' ' || *s == '\n'))
+			break;
+
+		++s;
+	} while (*s && depth > 0);
+
+	/* scalars end at the next delimiter */
+	while (depth == 0 && *s && !strchr(",}] \t\r\n", *s))
+		++s;
+
+	return s;
+}
+
+/*
+*	jget key: value of key in the JSON object on stdin, strings without
+*	their quotes. Only looks at the top level.
+*/
+static int plugin_jget(builtin_io* io, int argc, char* argv[]) {
+	char const *s, *key, *kend, *end;
+	char *data;
+	size_t len, klen;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: jget key\n");
+		return 2;
+	}
+	klen = strlen(argv[1]);
+
+	if (!(data = read_all(io->in, &len)))
+		return 1;
+
+	s = data + strspn(data, " \t\r\n");
+	if (*s++ != '{')
+		goto fail;
+
+	while (*s) {
+		s += strspn(s, " \t\r\n,");
+		if (*s != '"')
+			break;
+
+		key = s + 1;
+		s = skip_string(s);
+		kend = s - 1;
+		s += strspn(s, " \t\r\n");
+		if (*s++ != ':')
+			break;
+		s += strspn(s, " \t\r\n");
+
+		end = skip_value(s);
+		if ((size_t)(kend - key) == klen &&
+			strncmp(key, argv[1], klen) == 0) {
+			if (*s == '"') {
+				/* the input can end before the string does */
+				if (end < s + 2 || end[-1] != '"') {
+					fprintf(stderr, "jget: %s: unterminated string\n",
+						argv[1]);
+					free(data);
+					return 1;
+				}
+				io_write(io, s + 1, end - s - 2);
+			} else
+				io_write(io, s, end - s);
+			io_write(io, "\n", 1);
+			free(data);
+			return 0;
+		}
+		s = end;
+	}
+
+fail:
+	free(data);
+	return 1;
+}
+
+/*
+*	counter [-r]: prints how many times it's been run in this shell.
+*	Only means anything in-process, a pipeline forks its own copy.
+*/
+static int plugin_counter(builtin_io* io, int argc, char* argv[]) {
+	static unsigned long count = 0;
+
+	if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+		count = 0;
+		return 0;
+	}
+
+	io_printf(io, "%lu\n", ++count);
+	return 0;
+}
@@ -0,0 +1,279 @@
+#include "prefix.h"
+
+#include "history.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* an entry while its run is being sorted, head is its first bytes
+ * big endian so most comparisons never have to go to the text */
+typedef struct sort_entry {
+	uint64_t head;
+	char const* text;
+	size_t len;
+	uint32_t id;
+} sort_entry;
+
+void add_run(prefix_index* idx, history* hist, uint32_t start,
+	uint32_t count);
+int compare_entries(void const* a, void const* b);
+int compare_ids(history* hist, uint32_t a, uint32_t b);
+bool start_merge(prefix_index* idx);
+void merge_step(prefix_index* idx, history* hist);
+int compare_prefix(history* hist, uint32_t id, char const* text,
+	size_t len);
+size_t find_in_run(prefix_run* run, history* hist, char const* text,
+	size_t len);
+
+/*
+*	Public functions
+*/
+
+/*
+*	Nothing gets sorted yet, the count entries already there are left
+*	for prefix_build
+*/
+prefix_index* prefix_init(size_t count) {
+	prefix_index *idx = malloc(sizeof(prefix_index));
+
+	idx->runs = NULL;
+	idx->runc = idx->run_cap = 0;
+	idx->merge.ids = NULL;
+	idx->lo = idx->hi = count;
+
+	return idx;
+}
+
+void prefix_destroy(prefix_index* idx) {
+	size_t i;
+
+	for (i = 0; i < idx->runc; ++i)
+		free(idx->runs[i].ids);
+	free(idx->runs);
+	free(idx->merge.ids);
+	free(idx);
+}
+
+/*
+*	One step of work: sorting new entries once there's a run's worth
+*	of them, else merging, else sorting the next older ones
+*/
+void prefix_build(prefix_index* idx, history* hist) {
+	size_t count = history_count(hist);
+	uint32_t n;
+
+	if (count - idx->hi >= PREFIX_RUN) {
+		add_run(idx, hist, idx->hi, PREFIX_RUN);
+		idx->hi += PREFIX_RUN;
+	} else if (idx->merge.ids || start_merge(idx)) {
+		merge_step(idx, hist);
+	} else if (idx->lo > 0) {
+		n = idx->lo < PREFIX_RUN ? idx->lo : PREFIX_RUN;
+		idx->lo -= n;
+		add_run(idx, hist, idx->lo, n);
+	}
+}
+
+/*
+*	Newest entry that starts with text and has more after it, or
+*	HISTORY_EDIT. Runs cover contiguous ids, so the first one with a
+*	match, newest first, has the answer.
+*/
+size_t prefix_find(prefix_index* idx, history* hist, char const* text,
+	size_t len) {
+
+	size_t n, i;
+
+	for (n = history_count(hist); n-- > idx->hi; ) {
+		if (history_len(hist, n) > len &&
+			memcmp(history_get(hist, n), text, len) == 0)
+			return n;
+	}
+
+	for (i = idx->runc; i-- > 0; ) {
+		if ((n = find_in_run(&idx->runs[i], hist, text, len)) !=
+			HISTORY_EDIT)
+			return n;
+	}
+
+	return HISTORY_EDIT;
+}
+
+/*
+*	Private functions
+*/
+
+void add_run(prefix_index* idx, history* hist, uint32_t start,
+	uint32_t count) {
+
+	sort_entry *sorted = malloc(sizeof(sort_entry) * count);
+	prefix_run *run;
+	size_t at;
+	uint32_t i, j;
+
+	for (i = 0; i < count; ++i) {
+		sorted[i].text = history_get(hist, start + i);
+		sorted[i].len = history_len(hist, start + i);
+		sorted[i].id = start + i;
+
+		sorted[i].head = 0;
+		for (j = 0; j < sizeof(uint64_t); ++j) {
+			sorted[i].head <<= 8;
+			if (j < sorted[i].len)
+				sorted[i].head |= (unsigned char)sorted[i].text[j];
+		}
+	}
+	qsort(sorted, count, sizeof(sort_entry), &compare_entries);
+
+	if (idx->runc == idx->run_cap) {
+		idx->run_cap = idx->run_cap ? idx->run_cap * 2 : 16;
+		idx->runs = realloc(idx->runs, sizeof(prefix_run) * idx->run_cap);
+	}
+
+	/* older runs go in front, new ones at the end */
+	at = start < idx->hi ? 0 : idx->runc;
+	memmove(idx->runs + at + 1, idx->runs + at,
+		sizeof(prefix_run) * (idx->runc - at));
+	++idx->runc;
+
+	run = &idx->runs[at];
+	run->start = start;
+	run->count = count;
+	run->ids = malloc(sizeof(uint32_t) * count);
+	for (i = 0; i < count; ++i)
+		run->ids[i] = sorted[i].id;
+
+	free(sorted);
+}
+
+int compare_entries(void const* a, void const* b) {
+	sort_entry const *x = a, *y = b;
+	int c;
+
+	if (x->head != y->head)
+		return x->head < y->head ? -1 : 1;
+
+	c = memcmp(x->text, y->text, x->len < y->len ? x->len : y->len);
+	if (c)
+		return c;
+
+	return (x->len > y->len) - (x->len < y->len);
+}
+
+/* same order as compare_entries */
+int compare_ids(history* hist, uint32_t a, uint32_t b) {
+	size_t alen = history_len(hist, a), blen = history_len(hist, b);
+	int c = memcmp(history_get(hist, a), history_get(hist, b),
+		alen < blen ? alen : blen);
+
+	if (c)
+		return c;
+
+	return (alen > blen) - (alen < blen);
+}
+
+/*
+*	Picks the smallest pair of neighbouring runs with the same size.
+*	Runs only ever come in at either end, so sizes go up towards the
+*	middle and this keeps it to about two runs per size.
+*/
+bool start_merge(prefix_index* idx) {
+	size_t i, best = idx->runc;
+
+	for (i = 0; i + 1 < idx->runc; ++i) {
+		if (idx->runs[i].count == idx->runs[i + 1].count &&
+			(best == idx->runc || idx->runs[i].count < idx->runs[best].count))
+			best = i;
+	}
+
+	if (best == idx->runc)
+		return false;
+
+	idx->merge.at = best;
+	idx->merge.ids = malloc(sizeof(uint32_t) * 2 * idx->runs[best].count);
+	idx->merge.a = idx->merge.b = 0;
+
+	return true;
+}
+
+/*
+*	Merges a bit more. Both runs are still searched until it's done
+*	and the merged one takes their place.
+*/
+void merge_step(prefix_index* idx, history* hist) {
+	prefix_merge *m = &idx->merge;
+	prefix_run *x = &idx->runs[m->at], *y = x + 1;
+	uint32_t *out = m->ids + m->a + m->b;
+	size_t steps;
+
+	for (steps = 0; steps < PREFIX_MERGE_STEP; ++steps) {
+		if (m->a == x->count && m->b == y->count)
+			break;
+
+		if (m->b == y->count || (m->a < x->count &&
+			compare_ids(hist, x->ids[m->a], y->ids[m->b]) <= 0))
+			*out++ = x->ids[m->a++];
+		else
+			*out++ = y->ids[m->b++];
+	}
+
+	if (m->a < x->count || m->b < y->count)
+		return;
+
+	/* x comes first, so the merged run starts where it does */
+	free(x->ids);
+	free(y->ids);
+	x->ids = m->ids;
+	x->count += y->count;
+
+	memmove(y, y + 1, sizeof(prefix_run) * (idx->runc - m->at - 2));
+	--idx->runc;
+	m->ids = NULL;
+}
+
+/* entry id against text, only looking at the entry's first len bytes */
+int compare_prefix(history* hist, uint32_t id, char const* text,
+	size_t len) {
+
+	size_t elen = history_len(hist, id);
+	int c = memcmp(history_get(hist, id), text, elen < len ? elen : len);
+
+	if (c)
+		return c;
+
+	return elen < len ? -1 : 0;
+}
+
+/* the entries starting with text are all together, take the newest */
+size_t find_in_run(prefix_run* run, history* hist, char const* text,
+	size_t len) {
+
+	size_t lo = 0, hi = run->count, mid, end, best = HISTORY_EDIT;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (compare_prefix(hist, run->ids[mid], text, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	end = run->count;
+	while (hi < end) {
+		mid = hi + (end - hi) / 2;
+		if (compare_prefix(hist, run->ids[mid], text, len) <= 0)
+			hi = mid + 1;
+		else
+			end = mid;
+	}
+
+	/* the line itself sorts first, it needs more after it */
+	for (; lo < hi; ++lo) {
+		if ((best == HISTORY_EDIT || run->ids[lo] > best) &&
+			history_len(hist, run->ids[lo]) > len)
+			best = run->ids[lo];
+	}
+
+	return best;
+}
@@ -0,0 +1,56 @@
+#ifndef _PREFIX_GUARD
+#define _PREFIX_GUARD
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct history;
+
+/* entries sorted per build step, which bounds what a keystroke costs */
+#define PREFIX_RUN 2048
+/* comparisons a merge gets per build step, less than sorting a run */
+#define PREFIX_MERGE_STEP (2 * PREFIX_RUN)
+
+/* ids start..start+count, sorted by their text */
+typedef struct prefix_run {
+	uint32_t start;
+	uint32_t count;
+	uint32_t* ids;
+} prefix_run;
+
+/* runs[at] and runs[at + 1] going into ids, a and b from each so far */
+typedef struct prefix_merge {
+	size_t at;
+	uint32_t* ids;
+	uint32_t a;
+	uint32_t b;
+} prefix_merge;
+
+/*
+*	Index of history entries by how they start, for autosuggestions.
+*	It's built a run at a time, newest entries first, so the first key
+*	doesn't wait for all of history. Entries past hi (the newest, fewer
+*	than a run) are just scanned, entries below lo aren't found until
+*	their run is built. Neighbouring runs of the same size get merged,
+*	also a bit per step, so there are only O(log n) runs to search.
+*/
+typedef struct prefix_index {
+	/* by start, oldest first */
+	prefix_run* runs;
+	size_t runc;
+	size_t run_cap;
+	/* ids is NULL when there's nothing to merge */
+	prefix_merge merge;
+
+	uint32_t lo;
+	uint32_t hi;
+} prefix_index;
+
+prefix_index* prefix_init(size_t count);
+void prefix_destroy(prefix_index* idx);
+
+void prefix_build(prefix_index* idx, struct history* hist);
+size_t prefix_find(prefix_index* idx, struct history* hist,
+	char const* text, size_t len);
+
+#endif
@@ -0,0 +1,479 @@
+/* for pipe2 */
+#define _GNU_SOURCE
+
+#include "prompt.h"
+
+#include "shell.h"
+#include "jobs.h"
+#include "cmdhash.h"
+#include "strmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/eventfd.h>
+#include <linux/limits.h>
+
+extern char **environ;
+
+segment* add_segment(prompt* p, segment_type type);
+void segment_text(segment* seg, char const* text, size_t len);
+unsigned long segment_key(prompt* p, segment* seg, shell_state* sh);
+void render_segment(prompt* p, segment* seg, shell_state* sh);
+int count_jobs(shell_state* sh);
+void* prompt_worker(void* data);
+char* git_status(char const* git, char const* dir, char** env);
+char** copy_env(void);
+void free_env(char** env);
+
+/*
+*	Public functions
+*/
+
+/*
+*	Splits the template into segments, e.g. "[%w] $ " is text, cwd
+*	and text again. %% is a plain %.
+*/
+prompt* prompt_init(char const* template) {
+	prompt *p = malloc(sizeof(prompt));
+	char const *c, *start;
+
+	p->segs = NULL;
+	p->segc = 0;
+	p->len = 0;
+	/* room for most prompts up front, with a long cwd */
+	p->cap = PATH_MAX + 64;
+	p->buf = malloc(p->cap);
+	p->buf[0] = '\0';
+
+	p->efd = -1;
+	p->started = false;
+	p->quit = false;
+	p->want = p->git = NULL;
+	p->env = NULL;
+	p->done_dir = p->done_text = NULL;
+	p->cache = strmap_init();
+	p->cache_gen = 0;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->wake, NULL);
+
+	for (c = template; *c; ) {
+		if (*c != '%' || !c[1]) {
+			for (start = c++; *c && *c != '%'; ++c) {}
+			segment_text(add_segment(p, SEG_TEXT), start, c - start);
+			continue;
+		}
+
+		switch (c[1]) {
+		case 'w': add_segment(p, SEG_CWD); break;
+		case 'W': add_segment(p, SEG_BASENAME); break;
+		case 'u': add_segment(p, SEG_USER); break;
+		case 'h': add_segment(p, SEG_HOST); break;
+		case '?': add_segment(p, SEG_STATUS); break;
+		case 'j': add_segment(p, SEG_JOBS); break;
+		case 'g':
+			add_segment(p, SEG_GIT);
+			if (p->efd < 0)
+				p->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			break;
+		case '%':
+			segment_text(add_segment(p, SEG_TEXT), "%", 1);
+			break;
+		default:
+			/* not ours, leave it as it is */
+			segment_text(add_segment(p, SEG_TEXT), c, 2);
+			break;
+		}
+		c += 2;
+	}
+
+	return p;
+}
+
+void prompt_destroy(prompt* p) {
+	int i;
+
+	if (p->started) {
+		pthread_mutex_lock(&p->lock);
+		p->quit = true;
+		pthread_cond_signal(&p->wake);
+		pthread_mutex_unlock(&p->lock);
+		pthread_join(p->worker, NULL);
+	}
+
+	if (p->efd >= 0)
+		close(p->efd);
+	pthread_cond_destroy(&p->wake);
+	pthread_mutex_destroy(&p->lock);
+
+	free(p->want);
+	free(p->git);
+	free_env(p->env);
+	free(p->done_dir);
+	free(p->done_text);
+	strmap_destroy(p->cache, &free);
+
+	for (i = 0; i < p->segc; ++i)
+		free(p->segs[i].text);
+
+	free(p->segs);
+	free(p->buf);
+	free(p);
+}
+
+/*
+*	Returns the prompt text, valid until the next call. Only segments
+*	whose input changed get rendered again.
+*/
+char const* prompt_render(prompt* p, shell_state* sh) {
+	segment *seg;
+	unsigned long key;
+	bool changed = false;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < p->segc; ++i) {
+		seg = &p->segs[i];
+		key = segment_key(p, seg, sh);
+
+		if (!seg->rendered || seg->key != key) {
+			render_segment(p, seg, sh);
+			seg->key = key;
+			seg->rendered = true;
+			changed = true;
+		}
+
+		len += seg->len;
+	}
+
+	if (!changed)
+		return p->buf;
+
+	if (len + 1 > p->cap) {
+		p->cap = len + 1;
+		p->buf = realloc(p->buf, p->cap);
+	}
+
+	for (i = 0, p->len = 0; i < p->segc; ++i) {
+		memcpy(p->buf + p->len, p->segs[i].text, p->segs[i].len);
+		p->len += p->segs[i].len;
+	}
+	p->buf[p->len] = '\0';
+
+	return p->buf;
+}
+
+/*
+*	Asks the worker to look at the current directory again, e.g. after
+*	a command that might have touched the repository. Anything it was
+*	asked before and hasn't got to yet is dropped.
+*/
+void prompt_refresh(prompt* p, shell_state* sh) {
+	char const *git;
+	sigset_t all, old;
+
+	if (p->efd < 0)
+		return;
+
+	/* the worker mustn't look at $PATH or environ while the main
+	 * thread might be changing them, so it gets its own copies */
+	if (!(git = cmdhash_peek(sh->jobs->hash, "git")))
+		return;
+
+	pthread_mutex_lock(&p->lock);
+	free(p->want);
+	free(p->git);
+	free_env(p->env);
+	p->want = strdup(sh->cwd);
+	p->git = strdup(git);
+	p->env = copy_env();
+	pthread_cond_signal(&p->wake);
+	pthread_mutex_unlock(&p->lock);
+
+	if (p->started)
+		return;
+
+	/* signals belong to the main thread's signalfds */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	p->started = pthread_create(&p->worker, NULL, &prompt_worker, p) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/*
+*	Called when efd is readable, takes what the worker found. Returns
+*	true if the prompt for the current directory looks different now.
+*/
+bool prompt_collect(prompt* p, shell_state* sh) {
+	uint64_t n;
+	char *dir, *text, *old;
+	bool changed;
+
+	while (read(p->efd, &n, sizeof(n)) == sizeof(n)) {}
+
+	pthread_mutex_lock(&p->lock);
+	dir = p->done_dir;
+	text = p->done_text;
+	p->done_dir = p->done_text = NULL;
+	pthread_mutex_unlock(&p->lock);
+
+	if (!dir)
+		return false;
+
+	old = strmap_put(p->cache, dir, text);
+	changed = strcmp(dir, sh->cwd) == 0 &&
+		strcmp(old ? old : "", text) != 0;
+
+	free(old);
+	free(dir);
+
+	if (changed)
+		++p->cache_gen;
+
+	return changed;
+}
+
+/*
+*	Private functions
+*/
+
+segment* add_segment(prompt* p, segment_type type) {
+	segment *seg;
+
+	p->segs = realloc(p->segs, sizeof(segment) * (p->segc + 1));
+	seg = &p->segs[p->segc++];
+
+	seg->type = type;
+	seg->key = 0;
+	seg->rendered = false;
+	seg->text = NULL;
+	seg->len = seg->cap = 0;
+
+	return seg;
+}
+
+void segment_text(segment* seg, char const* text, size_t len) {
+	if (len + 1 > seg->cap) {
+		seg->cap = len + 1;
+		seg->text = realloc(seg->text, seg->cap);
+	}
+
+	memcpy(seg->text, text, len);
+	seg->text[len] = '\0';
+	seg->len = len;
+}
+
+/* changes whenever the segment would render differently */
+unsigned long segment_key(prompt* p, segment* seg, shell_state* sh) {
+	switch (seg->type) {
+	case SEG_CWD:
+	case SEG_BASENAME:
+		return sh->cwd_gen;
+	case SEG_STATUS:
+		return sh->jobs->status;
+	case SEG_JOBS:
+		return count_jobs(sh);
+	case SEG_GIT:
+		/* both only ever go up */
+		return (unsigned long)sh->cwd_gen + p->cache_gen;
+	default:
+		return 0;
+	}
+}
+
+void render_segment(prompt* p, segment* seg, shell_state* sh) {
+	char buf[256];
+	char const *s;
+
+	switch (seg->type) {
+	case SEG_TEXT:
+		break;
+	case SEG_CWD:
+		segment_text(seg, sh->cwd, strlen(sh->cwd));
+		break;
+	case SEG_BASENAME:
+		s = strrchr(sh->cwd, '/');
+		s = (s && s[1]) ? s + 1 : sh->cwd;
+		segment_text(seg, s, strlen(s));
+		break;
+	case SEG_USER:
+		s = getenv("USER");
+		if (!s)
+			s = "?";
+		segment_text(seg, s, strlen(s));
+		break;
+	case SEG_HOST:
+		if (gethostname(buf, sizeof(buf)) < 0)
+			strcpy(buf, "?");
+		buf[sizeof(buf) - 1] = '\0';
+		segment_text(seg, buf, strlen(buf));
+		break;
+	case SEG_STATUS:
+		snprintf(buf, sizeof(buf), "%d", sh->jobs->status);
+		segment_text(seg, buf, strlen(buf));
+		break;
+	case SEG_JOBS:
+		snprintf(buf, sizeof(buf), "%d", count_jobs(sh));
+		segment_text(seg, buf, strlen(buf));
+		break;
+	case SEG_GIT:
+		/* whatever was found here last, the worker catches up */
+		s = strmap_get(p->cache, sh->cwd);
+		if (!s)
+			s = "";
+		segment_text(seg, s, strlen(s));
+		break;
+	}
+}
+
+int count_jobs(shell_state* sh) {
+	job *j;
+	int n = 0;
+
+	for (j = sh->jobs->first_job; j; j = j->next)
+		++n;
+
+	return n;
+}
+
+/*
+*	Worker thread, sleeps until prompt_refresh wants something and
+*	hands the result back through efd
+*/
+void* prompt_worker(void* data) {
+	prompt *p = data;
+	char *dir, *git, **env, *text;
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&p->lock);
+	while (!p->quit) {
+		if (!p->want) {
+			pthread_cond_wait(&p->wake, &p->lock);
+			continue;
+		}
+
+		dir = p->want;
+		git = p->git;
+		env = p->env;
+		p->want = p->git = NULL;
+		p->env = NULL;
+		pthread_mutex_unlock(&p->lock);
+
+		text = git_status(git, dir, env);
+		free(git);
+		free_env(env);
+
+		pthread_mutex_lock(&p->lock);
+		free(p->done_dir);
+		free(p->done_text);
+		p->done_dir = dir;
+		p->done_text = text;
+
+		if (write(p->efd, &one, sizeof(one)) < 0)
+			perror("psh: prompt");
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+/*
+*	Branch of the repository dir is in, with a * if tracked files have
+*	changes. Empty if it's not in one. The git process gets reaped by
+*	jobs_update with everything else.
+*/
+char* git_status(char const* git, char const* dir, char** env) {
+	char *argv[] = {"git", "-C", (char*)dir, "status", "--porcelain=v2",
+		"--branch", "-uno", NULL};
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t none;
+	char *line = NULL, *head = NULL, *text;
+	size_t cap = 0;
+	ssize_t len;
+	bool dirty = false;
+	FILE *out;
+	pid_t pid;
+	int fds[2];
+	int err;
+
+	if (pipe2(fds, O_CLOEXEC) < 0)
+		return strdup("");
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+		O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+		O_WRONLY, 0);
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+	sigemptyset(&none);
+	posix_spawnattr_setsigmask(&attr, &none);
+
+	err = posix_spawn(&pid, git, &actions, &attr, argv, env);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	close(fds[1]);
+
+	if (err) {
+		close(fds[0]);
+		return strdup("");
+	}
+
+	out = fdopen(fds[0], "r");
+	while ((len = getline(&line, &cap, out)) > 0) {
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		if (strncmp(line, "# branch.head ", 14) == 0) {
+			free(head);
+			head = strdup(line + 14);
+		} else if (line[0] != '#') {
+			dirty = true;
+		}
+	}
+	fclose(out);
+	free(line);
+
+	if (!head)
+		return strdup("");
+
+	text = malloc(strlen(head) + 2);
+	sprintf(text, "%s%s", head, dirty ? "*" : "");
+	free(head);
+
+	return text;
+}
+
+char** copy_env(void) {
+	char **env;
+	int i, n;
+
+	for (n = 0; environ[n]; ++n) {}
+
+	env = malloc(sizeof(char*) * (n + 1));
+	for (i = 0; i < n; ++i)
+		env[i] = strdup(environ[i]);
+	env[n] = NULL;
+
+	return env;
+}
+
+void free_env(char** env) {
+	int i;
+
+	if (!env)
+		return;
+
+	for (i = 0; env[i]; ++i)
+		free(env[i]);
+	free(env);
+}
@@ -0,0 +1,82 @@
+#ifndef _PROMPT_GUARD
+#define _PROMPT_GUARD
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+struct shell_state;
+struct strmap;
+
+/* what goes in the prompt when $PSH_PROMPT isn't set */
+#define DEFAULT_PROMPT "[%w] $ "
+
+typedef enum segment_type {
+	SEG_TEXT, /* plain text from the template */
+	SEG_CWD, /* %w */
+	SEG_BASENAME, /* %W */
+	SEG_USER, /* %u */
+	SEG_HOST, /* %h */
+	SEG_STATUS, /* %? */
+	SEG_JOBS, /* %j */
+	SEG_GIT /* %g, worked out by the worker */
+} segment_type;
+
+/* one piece of the prompt, rendered only when its input changes */
+typedef struct segment {
+	segment_type type;
+
+	/* what it was last rendered from */
+	unsigned long key;
+	bool rendered;
+
+	char* text;
+	size_t len;
+	size_t cap;
+} segment;
+
+typedef struct prompt {
+	segment* segs;
+	int segc;
+
+	/* all the segments together, only put back together when one of
+	 * them changes */
+	char* buf;
+	size_t len;
+	size_t cap;
+
+	/*
+	*	Slow segments are worked out on a thread so the prompt never
+	*	waits for them. It shows whatever was last found for the
+	*	directory, the worker says when it has something new through
+	*	efd (-1 if the template has nothing slow in it) and the prompt
+	*	gets redrawn.
+	*/
+	int efd;
+	bool started;
+	pthread_t worker;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+
+	/* guarded by lock: what to look at next (NULL when there's
+	 * nothing to do) and what was found last */
+	bool quit;
+	char* want;
+	char* git;
+	char** env;
+	char* done_dir;
+	char* done_text;
+
+	/* main thread only, directory -> what the worker found there */
+	struct strmap* cache;
+	unsigned int cache_gen;
+} prompt;
+
+prompt* prompt_init(char const* template);
+void prompt_destroy(prompt* p);
+
+char const* prompt_render(prompt* p, struct shell_state* sh);
+void prompt_refresh(prompt* p, struct shell_state* sh);
+bool prompt_collect(prompt* p, struct shell_state* sh);
+
+#endif
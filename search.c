@@ -0,0 +1,374 @@
+#define _GNU_SOURCE
+#include "search.h"
+
+#include "history.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TRIGRAM(s) \
+	((uint32_t)(unsigned char)(s)[0] << 16 | \
+	(uint32_t)(unsigned char)(s)[1] << 8 | \
+	(uint32_t)(unsigned char)(s)[2])
+
+void catch_up(search_index* idx, size_t max);
+void clear_index(search_index* idx);
+posting* find_posting(search_index* idx, uint32_t key);
+void index_entry(search_index* idx, uint32_t id);
+void grow_table(search_index* idx);
+size_t last_before(posting* p, size_t before);
+size_t seek(posting* p, size_t pos, uint32_t id);
+void add_id(posting* p, uint32_t id);
+void newest_in(posting* p, size_t before, size_t* best);
+size_t find_short(search_index* idx, char const* pattern, size_t len,
+	size_t before);
+size_t find_byte(search_index* idx, unsigned char c, size_t before);
+
+/*
+*	Public functions
+*/
+
+search_index* search_init(struct history* hist) {
+	search_index *idx = malloc(sizeof(search_index));
+
+	idx->hist = hist;
+	idx->gen = hist->gen;
+	idx->indexed = 0;
+	idx->table = NULL;
+	idx->size = idx->used = 0;
+	idx->shorts.ids = NULL;
+	idx->shorts.count = idx->shorts.cap = 0;
+	idx->bytes = NULL;
+	idx->words = 0;
+
+	return idx;
+}
+
+void search_destroy(search_index* idx) {
+	clear_index(idx);
+	free(idx);
+}
+
+/*
+*	Newest entry older than before that contains pattern, HISTORY_EDIT
+*	if there's none. Of what's indexed, only entries with the pattern's
+*	rarest trigram get looked at, or for shorter patterns find_short
+*	works it out from the index alone.
+*/
+size_t search_find(search_index* idx, char const* pattern, size_t len,
+	size_t before) {
+
+	history *hist = idx->hist;
+	posting *p, *join[SEARCH_JOIN];
+	size_t pos[SEARCH_JOIN];
+	size_t i, j, n = 0;
+	uint32_t id;
+
+	catch_up(idx, SEARCH_STEP);
+
+	if (before > hist->count)
+		before = hist->count;
+
+	/* not indexed yet */
+	while (before > idx->indexed) {
+		--before;
+		if (memmem(history_get(hist, before), history_len(hist, before),
+			pattern, len))
+			return before;
+	}
+
+	if (len < 3)
+		return find_short(idx, pattern, len, before);
+
+	/* the rarest few trigrams, rarest first */
+	for (i = 0; i + 3 <= len; ++i) {
+		p = find_posting(idx, TRIGRAM(pattern + i));
+		if (!p->key)
+			return HISTORY_EDIT;
+
+		for (j = n; j > 0 && join[j - 1]->count > p->count; --j) {
+			if (j < SEARCH_JOIN)
+				join[j] = join[j - 1];
+		}
+		if (j < SEARCH_JOIN)
+			join[j] = p;
+		if (n < SEARCH_JOIN)
+			++n;
+	}
+
+	for (j = 0; j < n; ++j)
+		pos[j] = last_before(join[j], before);
+
+	/* newest id they all have, then check it really has the pattern */
+	while (pos[0]) {
+		id = join[0]->ids[pos[0] - 1];
+
+		for (j = 1; j < n; ++j) {
+			pos[j] = seek(join[j], pos[j], id);
+			if (!pos[j])
+				return HISTORY_EDIT;
+			if (join[j]->ids[pos[j] - 1] != id)
+				break;
+		}
+
+		if (j < n) {
+			/* nothing they all have is newer than what this one has */
+			pos[0] = seek(join[0], pos[0], join[j]->ids[pos[j] - 1]);
+			continue;
+		}
+
+		if (memmem(history_get(hist, id), history_len(hist, id),
+			pattern, len))
+			return id;
+		--pos[0];
+	}
+
+	return HISTORY_EDIT;
+}
+
+/*
+*	Indexes a bit more, for idle time. Returns false once everything is.
+*/
+bool search_step(search_index* idx) {
+	catch_up(idx, SEARCH_STEP);
+
+	return idx->indexed < history_count(idx->hist);
+}
+
+/*
+*	Private functions
+*/
+
+/* indexes up to max of the entries that haven't been yet */
+void catch_up(search_index* idx, size_t max) {
+	history *hist = idx->hist;
+	size_t count = history_count(hist);
+
+	if (idx->gen != hist->gen) {
+		clear_index(idx);
+		idx->gen = hist->gen;
+	}
+
+	if (count - idx->indexed > max)
+		count = idx->indexed + max;
+
+	for (; idx->indexed < count; ++idx->indexed)
+		index_entry(idx, idx->indexed);
+}
+
+void clear_index(search_index* idx) {
+	size_t i;
+
+	for (i = 0; i < idx->size; ++i)
+		free(idx->table[i].ids);
+	free(idx->table);
+	free(idx->shorts.ids);
+	free(idx->bytes);
+
+	idx->table = NULL;
+	idx->size = idx->used = 0;
+	idx->shorts.ids = NULL;
+	idx->shorts.count = idx->shorts.cap = 0;
+	idx->bytes = NULL;
+	idx->words = 0;
+	idx->indexed = 0;
+}
+
+/* the slot for key, with key 0 if it isn't in the table */
+posting* find_posting(search_index* idx, uint32_t key) {
+	static posting empty;
+	size_t mask = idx->size - 1;
+	size_t i;
+
+	if (!idx->table)
+		return &empty;
+
+	for (i = (key * 2654435761u) & mask; idx->table[i].key;
+		i = (i + 1) & mask) {
+
+		if (idx->table[i].key == key)
+			break;
+	}
+
+	return &idx->table[i];
+}
+
+void index_entry(search_index* idx, uint32_t id) {
+	char const *text = history_get(idx->hist, id);
+	size_t len = history_len(idx->hist, id);
+	size_t w = id / SEARCH_BLOCK / 64;
+	uint64_t bit = 1ull << (id / SEARCH_BLOCK % 64);
+	posting *p;
+	size_t i;
+
+	if (w >= idx->words) {
+		idx->bytes = realloc(idx->bytes, sizeof(uint64_t) * 256 * (w + 1));
+		memset(idx->bytes + 256 * idx->words, 0,
+			sizeof(uint64_t) * 256 * (w + 1 - idx->words));
+		idx->words = w + 1;
+	}
+
+	for (i = 0; i < len; ++i)
+		idx->bytes[w * 256 + (unsigned char)text[i]] |= bit;
+
+	if (len < 3)
+		add_id(&idx->shorts, id);
+
+	for (i = 0; i + 3 <= len; ++i) {
+		if (idx->used * 2 >= idx->size)
+			grow_table(idx);
+
+		p = find_posting(idx, TRIGRAM(text + i));
+		if (!p->key) {
+			p->key = TRIGRAM(text + i);
+			++idx->used;
+		}
+
+		/* the same trigram twice in one entry */
+		if (p->count && p->ids[p->count - 1] == id)
+			continue;
+
+		add_id(p, id);
+	}
+}
+
+void grow_table(search_index* idx) {
+	posting *old = idx->table;
+	size_t size = idx->size;
+	size_t i;
+
+	idx->size = size ? size * 2 : 1024;
+	idx->table = calloc(idx->size, sizeof(posting));
+
+	for (i = 0; i < size; ++i) {
+		if (old[i].key)
+			*find_posting(idx, old[i].key) = old[i];
+	}
+
+	free(old);
+}
+
+/* how many of p's ids are below before */
+size_t last_before(posting* p, size_t before) {
+	size_t lo = 0, hi = p->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (p->ids[mid] < before)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+void add_id(posting* p, uint32_t id) {
+	if (p->count == p->cap) {
+		p->cap = p->cap ? p->cap * 2 : 4;
+		p->ids = realloc(p->ids, sizeof(uint32_t) * p->cap);
+	}
+	p->ids[p->count++] = id;
+}
+
+/* p's newest id below before, if it's newer than best */
+void newest_in(posting* p, size_t before, size_t* best) {
+	size_t n = last_before(p, before);
+
+	if (n && (*best == HISTORY_EDIT || p->ids[n - 1] > *best))
+		*best = p->ids[n - 1];
+}
+
+/*
+*	One or two bytes, everything before before is indexed. An entry
+*	with two bytes next to each other has them in a trigram, either
+*	first or last, unless it's too short to have any trigrams.
+*/
+size_t find_short(search_index* idx, char const* pattern, size_t len,
+	size_t before) {
+
+	unsigned char a = pattern[0], b = pattern[1];
+	size_t best = HISTORY_EDIT, i;
+	uint32_t c, id;
+
+	if (len == 0)
+		return before ? before - 1 : HISTORY_EDIT;
+	if (len == 1)
+		return find_byte(idx, a, before);
+
+	for (c = 1; c < 256; ++c) {
+		newest_in(find_posting(idx, (uint32_t)a << 16 | b << 8 | c),
+			before, &best);
+		newest_in(find_posting(idx, c << 16 | (uint32_t)a << 8 | b),
+			before, &best);
+	}
+
+	for (i = last_before(&idx->shorts, before); i-- > 0; ) {
+		id = idx->shorts.ids[i];
+		if (best != HISTORY_EDIT && id < best)
+			break;
+		if (memmem(history_get(idx->hist, id), history_len(idx->hist, id),
+			pattern, len))
+			return id;
+	}
+
+	return best;
+}
+
+/* newest block with the byte, then the entry in it that has it */
+size_t find_byte(search_index* idx, unsigned char c, size_t before) {
+	history *hist = idx->hist;
+	size_t block, w, id, start;
+	uint64_t bits;
+	int b;
+
+	if (!before)
+		return HISTORY_EDIT;
+
+	block = (before - 1) / SEARCH_BLOCK;
+	for (w = block / 64 + 1; w-- > 0; ) {
+		bits = idx->bytes[w * 256 + c];
+		/* blocks from before on don't count */
+		if (w == block / 64 && block % 64 != 63)
+			bits &= (2ull << block % 64) - 1;
+
+		for (; bits; bits &= ~(1ull << b)) {
+			b = 63 - __builtin_clzll(bits);
+			start = (w * 64 + b) * SEARCH_BLOCK;
+
+			id = start + SEARCH_BLOCK < before ? start + SEARCH_BLOCK : before;
+			while (id-- > start) {
+				if (memchr(history_get(hist, id), c, history_len(hist, id)))
+					return id;
+			}
+		}
+	}
+
+	return HISTORY_EDIT;
+}
+
+/*
+*	How many of p's first pos ids are at most id. Galloping back from
+*	pos, since a search only ever moves to older entries.
+*/
+size_t seek(posting* p, size_t pos, uint32_t id) {
+	size_t hi = pos, lo, step = 1, mid;
+
+	while (true) {
+		lo = hi > step ? hi - step : 0;
+		if (lo == 0 || p->ids[lo] <= id)
+			break;
+		hi = lo;
+		step *= 2;
+	}
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (p->ids[mid] <= id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
@@ -0,0 +1,63 @@
+#ifndef _SEARCH_GUARD
+#define _SEARCH_GUARD
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+struct history;
+
+/* entries indexed per key or idle tick, about a millisecond's worth */
+#define SEARCH_STEP 512
+/* trigrams whose entries get intersected before checking the text */
+#define SEARCH_JOIN 4
+/* entries per block in the byte bitmaps */
+#define SEARCH_BLOCK 64
+
+/* every entry containing one trigram, oldest first */
+typedef struct posting {
+	/* the three bytes, never 0 since entries have no NULs */
+	uint32_t key;
+
+	uint32_t* ids;
+	uint32_t count;
+	uint32_t cap;
+} posting;
+
+/*
+*	Trigram index over history for substring search, built a step at
+*	a time while searching and started over if history reloads.
+*	Whatever isn't indexed yet gets scanned. Patterns too short for
+*	trigrams use the trigrams they're part of, or for a single byte,
+*	which blocks of entries have it.
+*/
+typedef struct search_index {
+	struct history* hist;
+
+	/* history generation the ids belong to, and how many of its
+	 * entries have been indexed */
+	unsigned int gen;
+	size_t indexed;
+
+	/* open addressing, power of two */
+	posting* table;
+	size_t size;
+	size_t used;
+
+	/* entries with no trigrams at all, key unused */
+	posting shorts;
+
+	/* bit b of bytes[w * 256 + c] is set if block w * 64 + b has c
+	 * somewhere, words are added as blocks fill up */
+	uint64_t* bytes;
+	size_t words;
+} search_index;
+
+search_index* search_init(struct history* hist);
+void search_destroy(search_index* idx);
+
+size_t search_find(search_index* idx, char const* pattern, size_t len,
+	size_t before);
+bool search_step(search_index* idx);
+
+#endif
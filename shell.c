@@ -1,16 +1,35 @@
 #include "shell.h"
 #include "input.h"
 #include "jobs.h"
+#include "event.h"
+#include "builtin.h"
+#include "history.h"
+#include "display.h"
+#include "prompt.h"
+#include "parsecache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 
 #include <linux/limits.h>
 
-bool check_exit(parsed_line* line);
+/* give startup a moment before looking at compacting history */
+#define COMPACT_DELAY 2000
+
+/* how much of a script gets read at once */
+#define SCRIPT_CHUNK 65536
+
+shell_state* new_shell(void);
+void run_line(shell_state* sh, char* text);
+void shell_read(int fd, void* data);
+void compact_history(int fd, void* data);
+void prompt_ready(int fd, void* data);
+void draw_prompt(shell_state* sh);
 void ignore_signals(void);
 bool check_interactive(shell_state* sh);
 void make_foreground(shell_state* sh);
@@ -21,11 +40,10 @@ bool set_pgrp(shell_state* sh);
 */
 
 shell_state* shell_init(void) {
-	shell_state *sh = NULL;
+	shell_state *sh = new_shell();
 
-	sh = malloc(sizeof(shell_state));
-	sh->pid = getpid();
 	sh->term = STDIN_FILENO;
+	sh->interactive = true;
 
 	if (!check_interactive(sh))
 		goto error;
@@ -39,13 +57,66 @@ shell_state* shell_init(void) {
 	/* grab terminal */
 	tcsetpgrp(sh->term, sh->pgid);
 
+	if (!(sh->cwd = getcwd(NULL, 0))) {
+		perror("psh: cwd");
+		goto error;
+	}
+
+	builtin_init();
+
+	sh->prompt = prompt_init(getenv("PSH_PROMPT") ?
+		getenv("PSH_PROMPT") : DEFAULT_PROMPT);
+
 	if (!(sh->input = input_init()))
 		goto error;
 
 	if (!(sh->jobs = jobs_init()))
 		goto error;
 
-	print_prompt();
+	if (!(sh->events = event_init()))
+		goto error;
+
+	if (!event_add(sh->events, sh->term, &shell_read, sh) ||
+		!event_add(sh->events, sh->jobs->sigfd, &jobs_update, sh->jobs) ||
+		!event_add(sh->events, sh->input->display->sigfd, &input_resize,
+			sh->input))
+		goto error;
+
+	if (sh->prompt->efd >= 0 &&
+		!event_add(sh->events, sh->prompt->efd, &prompt_ready, sh))
+		goto error;
+
+	event_timer(sh->events, COMPACT_DELAY, &compact_history,
+		sh->input->history);
+
+	prompt_refresh(sh->prompt, sh);
+	draw_prompt(sh);
+
+	return sh;
+
+error:
+	shell_destroy(sh);
+	return NULL;
+}
+
+/*
+*	For scripts, -c and commands piped in: no terminal, line editor,
+*	prompt or history, nothing but what it takes to run commands
+*/
+shell_state* shell_init_batch(void) {
+	shell_state *sh = new_shell();
+
+	sh->pgid = getpgrp();
+
+	if (!(sh->cwd = getcwd(NULL, 0))) {
+		perror("psh: cwd");
+		goto error;
+	}
+
+	builtin_init();
+
+	if (!(sh->jobs = jobs_init()))
+		goto error;
 
 	return sh;
 
@@ -59,53 +130,265 @@ void shell_destroy(shell_state *sh) {
 		input_destroy(sh->input);
 	if (sh->jobs)
 		jobs_destroy(sh->jobs);
-
+	if (sh->events)
+		event_destroy(sh->events);
+	if (sh->prompt)
+		prompt_destroy(sh->prompt);
+	parsecache_destroy(sh->parsed);
+
+	builtin_destroy();
+	free(sh->cwd);
 	free(sh);
 }
 
+/*
+*	chdir that keeps sh->cwd up to date without asking getcwd. Like
+*	other shells it goes by the logical path, .. goes back up the way
+*	we came even past symlinks. Leaves errno set on failure.
+*/
+bool shell_chdir(shell_state* sh, char const* dir) {
+	char *path, *out, *seg;
+	size_t len;
+
+	len = strlen(sh->cwd) + strlen(dir) + 2;
+	path = malloc(len);
+	if (dir[0] == '/')
+		strcpy(path, dir);
+	else
+		snprintf(path, len, "%s/%s", sh->cwd, dir);
+
+	/* squash //, . and .. in place */
+	out = path;
+	for (seg = strtok(path, "/"); seg; seg = strtok(NULL, "/")) {
+		if (strcmp(seg, ".") == 0)
+			continue;
+
+		if (strcmp(seg, "..") == 0) {
+			while (out > path && *--out != '/') {}
+			continue;
+		}
+
+		*out++ = '/';
+		memmove(out, seg, strlen(seg));
+		out += strlen(seg);
+	}
+
+	if (out == path)
+		*out++ = '/';
+	*out = '\0';
+
+	if (chdir(path) == -1) {
+		free(path);
+		return false;
+	}
+
+	free(sh->cwd);
+	sh->cwd = path;
+	++sh->cwd_gen;
+
+	setenv("PWD", sh->cwd, 1);
+
+	return true;
+}
+
+/*
+*	Runs the script at path, stdin if it's NULL, a line at a time as
+*	it's read. Returns the status of the last command.
+*/
+int shell_source(shell_state* sh, char const* path) {
+	char *buf, *nl;
+	size_t len = 0, cap = SCRIPT_CHUNK, start;
+	ssize_t n;
+	int fd = STDIN_FILENO;
+
+	if (path && (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		fprintf(stderr, "psh: %s: %s\n", path, strerror(errno));
+		return 127;
+	}
+
+	buf = malloc(cap + 1);
+	while (sh->running) {
+		/* a line longer than what's buffered */
+		if (len == cap) {
+			cap *= 2;
+			buf = realloc(buf, cap + 1);
+		}
+
+		n = read(fd, buf + len, cap - len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		len += n;
+
+		/* run every whole line, the rest waits for the next read */
+		start = 0;
+		while (sh->running &&
+			(nl = memchr(buf + start, '\n', len - start))) {
+			*nl = '\0';
+			run_line(sh, buf + start);
+			start = nl - buf + 1;
+		}
+
+		memmove(buf, buf + start, len - start);
+		len -= start;
+	}
+
+	/* last line without a newline */
+	if (sh->running && len > 0) {
+		buf[len] = '\0';
+		run_line(sh, buf);
+	}
+
+	free(buf);
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	return sh->jobs->status;
+}
+
+/*
+*	psh -c text, can be more than one line
+*/
+int shell_eval(shell_state* sh, char const* text) {
+	char *copy = strdup(text);
+	char *line, *next;
+
+	for (line = copy; sh->running && line; line = next) {
+		if ((next = strchr(line, '\n')))
+			*next++ = '\0';
+		run_line(sh, line);
+	}
+
+	free(copy);
+	return sh->jobs->status;
+}
+
+/*
+*	One round of the main loop, sleeps until the terminal, a child or
+*	a timer needs attention
+*/
 bool shell_cmdloop(shell_state *sh) {
+	event_wait(sh->events);
+
+	return sh->running;
+}
+
+/*
+*	Private functions
+*/
+
+/*
+*	stdin handler, feeds the line editor and runs finished lines. One
+*	read can hold more than a line, e.g. typed ahead while a command
+*	was running, so keep going while there's input left.
+*/
+void shell_read(int fd, void* data) {
+	shell_state *sh = data;
 	parsed_line *line;
 
-	if ((line = input_process(sh->input)) != NULL) {
-		if (line->cmdc == 0)
-			return true;
+	UNUSED(fd);
+
+	do {
+		if ((line = input_process(sh->input)) == NULL) {
+			if (sh->input->closed)
+				sh->running = false;
+			continue;
+		}
 
-		if (check_exit(line)) {
-			free(line);
-			return false;
+		if (line->pipec == 0) {
+			if (line->error)
+				sh->jobs->status = 2;
+			line_release(line);
+			input_start(sh->input);
+			print_prompt();
+			continue;
 		}
 
 		jobs_process(sh->jobs, line);
-		line = NULL;
+		if (!sh->running)
+			return;
 
+		/* whatever ran might have changed what the slow parts show */
+		prompt_refresh(sh->prompt, sh);
+		input_start(sh->input);
 		print_prompt();
-	}
+	} while (sh->running && input_pending(sh->input));
+}
 
-	return true;
+shell_state* new_shell(void) {
+	shell_state *sh = malloc(sizeof(shell_state));
+
+	sh->input = NULL;
+	sh->jobs = NULL;
+	sh->events = NULL;
+	sh->prompt = NULL;
+	sh->parsed = parsecache_init();
+	sh->cwd = NULL;
+	sh->cwd_gen = 0;
+	sh->pid = getpid();
+	sh->pgid = 0;
+	sh->term = -1;
+	sh->running = true;
+	sh->interactive = false;
+
+	return sh;
 }
 
 /*
-*	Private functions
+*	One line of a script, exit stops the shell by clearing sh->running
 */
+void run_line(shell_state* sh, char* text) {
+	parsed_line *line;
 
-bool check_exit(parsed_line* line) {
-	if (line->argv[0] && line->argv[0][0] &&
-		(strcmp(line->argv[0][0], "exit") == 0)) {
-		return true;
+	text += strspn(text, " \t");
+	/* comments, which also takes care of #! */
+	if (!*text || *text == '#')
+		return;
+
+	line = parse_cached(sh->parsed, text);
+	if (line->pipec == 0) {
+		/* a syntax error ends a script, like in sh */
+		if (line->error) {
+			sh->jobs->status = 2;
+			sh->running = false;
+		}
+		line_release(line);
+		return;
 	}
 
-	return false;
+	jobs_process(sh->jobs, line);
+}
+
+/*
+*	One-shot timer after startup, history does the rest in the
+*	background if the file has grown past its cap
+*/
+void compact_history(int fd, void* data) {
+	UNUSED(fd);
+
+	history_compact(data);
+}
+
+/*
+*	The prompt worker is done, redraw the prompt where it is if that
+*	changed anything
+*/
+void prompt_ready(int fd, void* data) {
+	shell_state *sh = data;
+
+	UNUSED(fd);
+
+	if (prompt_collect(sh->prompt, sh))
+		input_repaint(sh->input, prompt_render(sh->prompt, sh));
 }
 
 void print_prompt(void) {
-	static char cwd[PATH_MAX];
+	draw_prompt(psh);
+}
 
-	if (!getcwd(cwd, PATH_MAX)) {
-		perror("psh:cwd");
-		exit(EXIT_FAILURE);
-	}
-	printf("[%s] $ ", cwd);
-	fflush(stdout);
+void draw_prompt(shell_state* sh) {
+	input_prompt(sh->input, prompt_render(sh->prompt, sh));
 }
 
 bool check_interactive(shell_state* sh) {
@@ -133,9 +416,6 @@ void ignore_signals(void) {
 	/* ignore background i/o */
 	signal(SIGTTOU, SIG_IGN);
 	signal(SIGTTIN, SIG_IGN);
-
-	/* child signal */
-	signal(SIGCHLD, &jobs_update);
 }
 
 bool set_pgrp(shell_state* sh) {
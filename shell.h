@@ -9,24 +9,44 @@
 
 struct input_state;
 struct jobs_state;
+struct event_loop;
+struct prompt;
+struct parsecache;
 
 typedef struct shell_state {
 	struct input_state *input;
 	struct jobs_state *jobs;
+	struct event_loop *events;
+	struct prompt *prompt;
+	/* lines that run more than once only get parsed once */
+	struct parsecache *parsed;
+
+	/* working directory, kept by cd so the prompt never has to ask
+	 * getcwd, cwd_gen goes up every time it changes */
+	char *cwd;
+	unsigned int cwd_gen;
 
 	pid_t pid;
 	pid_t pgid;
 
+	/* -1 when there's no terminal, i.e. running a script */
 	int term;
-	int pad;
+	bool running;
+	/* line editing, prompt and history, or just running commands */
+	bool interactive;
 } shell_state;
 
 extern shell_state *psh;
 
 shell_state* shell_init(void);
+shell_state* shell_init_batch(void);
 void shell_destroy(shell_state* sh);
 
+int shell_source(shell_state* sh, char const* path);
+int shell_eval(shell_state* sh, char const* text);
+
 void print_prompt(void);
+bool shell_chdir(shell_state* sh, char const* dir);
 
 bool shell_cmdloop(shell_state* sh);
 
@@ -0,0 +1,159 @@
+#include "strmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STRMAP_INITIAL 16
+
+strmap_entry** find_entry(strmap* map, char const* key, unsigned int hash);
+void grow(strmap* map);
+
+/*
+*	Public functions
+*/
+
+strmap* strmap_init(void) {
+	strmap *map = malloc(sizeof(strmap));
+
+	map->size = STRMAP_INITIAL;
+	map->count = 0;
+	map->buckets = calloc(map->size, sizeof(strmap_entry*));
+
+	return map;
+}
+
+void strmap_destroy(strmap* map, void (*free_value)(void*)) {
+	strmap_clear(map, free_value);
+	free(map->buckets);
+	free(map);
+}
+
+/*
+*	FNV-1a
+*/
+unsigned int strmap_hash(char const* key) {
+	unsigned int hash = 2166136261u;
+
+	while (*key) {
+		hash ^= (unsigned char)*key++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+void* strmap_get(strmap* map, char const* key) {
+	strmap_entry **e = find_entry(map, key, strmap_hash(key));
+
+	return *e ? (*e)->value : NULL;
+}
+
+/*
+*	Returns the value that was replaced, if any
+*/
+void* strmap_put(strmap* map, char const* key, void* value) {
+	unsigned int hash = strmap_hash(key);
+	strmap_entry **e = find_entry(map, key, hash);
+	strmap_entry *entry;
+	void *old;
+
+	if (*e) {
+		old = (*e)->value;
+		(*e)->value = value;
+		return old;
+	}
+
+	entry = malloc(sizeof(strmap_entry));
+	entry->next = NULL;
+	entry->hash = hash;
+	entry->key = strdup(key);
+	entry->value = value;
+	*e = entry;
+
+	if (++map->count > map->size)
+		grow(map);
+
+	return NULL;
+}
+
+/*
+*	Returns the removed value, if any
+*/
+void* strmap_remove(strmap* map, char const* key) {
+	strmap_entry **e = find_entry(map, key, strmap_hash(key));
+	strmap_entry *entry = *e;
+	void *value;
+
+	if (!entry)
+		return NULL;
+
+	*e = entry->next;
+	value = entry->value;
+	free(entry->key);
+	free(entry);
+	--map->count;
+
+	return value;
+}
+
+void strmap_clear(strmap* map, void (*free_value)(void*)) {
+	strmap_entry *e, *next;
+	int i;
+
+	for (i = 0; i < map->size; ++i) {
+		for (e = map->buckets[i]; e; e = next) {
+			next = e->next;
+			if (free_value)
+				free_value(e->value);
+			free(e->key);
+			free(e);
+		}
+		map->buckets[i] = NULL;
+	}
+
+	map->count = 0;
+}
+
+void strmap_foreach(strmap* map, strmap_func* func, void* data) {
+	strmap_entry *e;
+	int i;
+
+	for (i = 0; i < map->size; ++i) {
+		for (e = map->buckets[i]; e; e = e->next) {
+			func(e->key, e->value, data);
+		}
+	}
+}
+
+/*
+*	Private functions
+*/
+
+/* returns the link pointing at the entry, or the empty link at the end */
+strmap_entry** find_entry(strmap* map, char const* key, unsigned int hash) {
+	strmap_entry **e = &map->buckets[hash & (map->size - 1)];
+
+	while (*e && ((*e)->hash != hash || strcmp((*e)->key, key) != 0))
+		e = &(*e)->next;
+
+	return e;
+}
+
+void grow(strmap* map) {
+	strmap_entry **old = map->buckets;
+	strmap_entry *e, *next;
+	int i, n = map->size;
+
+	map->size *= 2;
+	map->buckets = calloc(map->size, sizeof(strmap_entry*));
+
+	for (i = 0; i < n; ++i) {
+		for (e = old[i]; e; e = next) {
+			next = e->next;
+			e->next = map->buckets[e->hash & (map->size - 1)];
+			map->buckets[e->hash & (map->size - 1)] = e;
+		}
+	}
+
+	free(old);
+}
@@ -0,0 +1,35 @@
+#ifndef _STRMAP_GUARD
+#define _STRMAP_GUARD
+
+/* string keyed hash map, keys are copied, values are up to the user */
+
+typedef struct strmap_entry {
+	struct strmap_entry* next;
+
+	unsigned int hash;
+	char* key;
+	void* value;
+} strmap_entry;
+
+typedef struct strmap {
+	/* power of two buckets */
+	strmap_entry** buckets;
+	int size;
+	int count;
+} strmap;
+
+typedef void(strmap_func)(char const* key, void* value, void* data);
+
+strmap* strmap_init(void);
+void strmap_destroy(strmap* map, void (*free_value)(void*));
+
+unsigned int strmap_hash(char const* key);
+
+void* strmap_get(strmap* map, char const* key);
+void* strmap_put(strmap* map, char const* key, void* value);
+void* strmap_remove(strmap* map, char const* key);
+void strmap_clear(strmap* map, void (*free_value)(void*));
+
+void strmap_foreach(strmap* map, strmap_func* func, void* data);
+
+#endif